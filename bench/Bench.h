@@ -0,0 +1,86 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace Bench
+{
+    // Bumped by the global operator new in main.cpp
+    inline std::atomic<size_t> Allocations = 0;
+
+    struct Options {
+        bool json = false;      // One JSON object per line instead of a table
+        std::string filter;     // Only run benchmarks whose name contains this
+    };
+
+    inline Options& GetOptions() {
+        static Options options;
+        return options;
+    }
+
+    void _Report(const std::string& name, size_t iterations, double nanoseconds, size_t allocations, double bytesPerOp) {
+        double nsPerOp = nanoseconds / static_cast<double>(iterations);
+        double allocsPerOp = static_cast<double>(allocations) / static_cast<double>(iterations);
+        double bytesPerSecond = bytesPerOp > 0.0 ? bytesPerOp * 1e9 / nsPerOp : 0.0;
+        if (GetOptions().json) {
+            std::printf("{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.1f,\"bytes_per_sec\":%.0f,\"allocs_per_op\":%.2f}\n",
+                name.c_str(), iterations, nsPerOp, bytesPerSecond, allocsPerOp);
+        }
+        else if (bytesPerOp > 0.0) {
+            std::printf("%-44s %14.0f ns/op %10.1f MB/s %10.2f allocs/op\n",
+                name.c_str(), nsPerOp, bytesPerSecond / 1e6, allocsPerOp);
+        }
+        else {
+            std::printf("%-44s %14.0f ns/op %16s %10.2f allocs/op\n", name.c_str(), nsPerOp, "", allocsPerOp);
+        }
+        std::fflush(stdout);
+    }
+
+    inline bool _Selected(const std::string& name) {
+        return GetOptions().filter.empty() || name.find(GetOptions().filter) != std::string::npos;
+    }
+
+    // Runs fn iterations times after one warm up call and reports the time per call
+    // bytesPerOp turns on the throughput column
+    void Run(const std::string& name, size_t iterations, const std::function<void()>& fn, double bytesPerOp = 0.0) {
+        if (!_Selected(name)) {
+            return;
+        }
+        fn();
+        size_t allocations = Allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            fn();
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        _Report(name, iterations, static_cast<double>(elapsed.count()),
+            Allocations.load(std::memory_order_relaxed) - allocations, bytesPerOp);
+    }
+
+    // Like Run, but setup runs before every call and is left out of the measurement
+    void RunWithSetup(const std::string& name, size_t iterations, const std::function<void()>& setup,
+        const std::function<void()>& fn, double bytesPerOp = 0.0) {
+        if (!_Selected(name)) {
+            return;
+        }
+        setup();
+        fn();
+        double nanoseconds = 0.0;
+        size_t allocations = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            setup();
+            size_t before = Allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            allocations += Allocations.load(std::memory_order_relaxed) - before;
+        }
+        _Report(name, iterations, nanoseconds, allocations, bytesPerOp);
+    }
+} // namespace Bench
+
+#endif /*BENCH_H_*/
@@ -0,0 +1,86 @@
+#ifndef CLIBENCH_H_
+#define CLIBENCH_H_
+
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+
+#include "Bench.h"
+#include "CLI.h"
+
+namespace Bench
+{
+    void CLIBenchmarks() {
+        // Commands script with three steps of 1000 commands each
+        char path[] = "/tmp/installer-bench-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            return;
+        }
+        close(fd);
+        {
+            std::ofstream file(path);
+            for (int step = 1; step <= 3; ++step) {
+                file << "# " << step << ". Step " << step << "\n";
+                for (int i = 0; i < 1000; ++i) {
+                    file << "# Comment for command " << i << "\n";
+                    file << "command" << i << " --flag value-" << i << " /mnt/path/" << i << "\n";
+                }
+            }
+        }
+        Bench::Run("cli/CommandScript index 3x1000", 200, [&]() { CommandScript script(path); });
+        {
+            CommandScript script(path);
+            size_t commands = 0;
+            Bench::Run("cli/CommandScript step 3 of 3x1000", 100000, [&]() {
+                commands += script.GetStep(3).size();
+                });
+        }
+        Bench::Run("cli/ParseCommands step 3 of 3x1000", 100000, [&]() {
+            CLI::ParseCommands(path, 3);
+            });
+        std::remove(path);
+
+        const double captureBytes = 100.0 * 1024 * 1024;
+        Bench::Run("cli/RunCommand capture 100 MiB", 5, []() {
+            CLI::RunCommand("head", "-c 104857600 /dev/zero");
+            }, captureBytes);
+        Bench::Run("cli/RunCommand lines 100 MiB", 5, []() {
+            size_t lines = 0;
+            CLI::RunCommand("head", "-c 104857600 /dev/zero", [&](std::string_view) { ++lines; });
+            }, captureBytes);
+
+        // Same capture with every chunk teed into the install log
+        char logDir[] = "/tmp/installer-bench-log-XXXXXX";
+        if (Bench::_Selected("cli/RunCommand capture 100 MiB logged") && mkdtemp(logDir)
+            && InstallLog::Recorder::Get().Start(logDir)) {
+            size_t dropped = InstallLog::Recorder::Get().GetDropped();
+            Bench::Run("cli/RunCommand capture 100 MiB logged", 5, []() {
+                CLI::RunCommand("head", "-c 104857600 /dev/zero");
+                }, captureBytes);
+            InstallLog::Recorder::Get().Stop();
+            std::printf("%-44s %zu bytes dropped\n", "  install log", InstallLog::Recorder::Get().GetDropped() - dropped);
+            std::filesystem::remove_all(logDir);
+        }
+
+        // Through the pty relay to /dev/null, the report itself still goes to stdout
+        int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        int savedStdout = dup(STDOUT_FILENO);
+        if (devNull != -1 && savedStdout != -1) {
+            Bench::Run("cli/RunInteractiveCommand relay 100 MiB", 5, [&]() {
+                std::fflush(stdout);
+                dup2(devNull, STDOUT_FILENO);
+                CLI::RunInteractiveCommand("head", "-c 104857600 /dev/zero");
+                dup2(savedStdout, STDOUT_FILENO);
+                }, captureBytes);
+        }
+        if (devNull != -1) {
+            close(devNull);
+        }
+        if (savedStdout != -1) {
+            close(savedStdout);
+        }
+    }
+} // namespace Bench
+
+#endif /*CLIBENCH_H_*/
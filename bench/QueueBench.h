@@ -0,0 +1,56 @@
+#ifndef QUEUEBENCH_H_
+#define QUEUEBENCH_H_
+
+#include <thread>
+
+#include "Bench.h"
+#include "KeyEvent.h"
+#include "KeyDecoder.h"
+
+namespace Bench
+{
+    void QueueBenchmarks() {
+        KeyEvent event(Key::Down);
+        const size_t batch = 100;
+
+        Bench::Run("queue/push+pop x100 same thread", 10000, [&]() {
+            EventQueue& queue = EventQueue::Get();
+            KeyEvent popped;
+            for (size_t i = 0; i < batch; ++i) {
+                queue.Push(event);
+            }
+            while (queue.Pop(popped)) {}
+            });
+
+        // A held arrow key plus typed text, as one large read
+        std::string input;
+        while (input.size() < 4096) {
+            input += "\033[B\033[B\033[1;5Aeurope/b\xc3\xa9rlin";
+        }
+        KeyDecoder decoder;
+        size_t keys = 0;
+        Bench::Run("input/KeyDecoder 4 KiB read", 10000, [&]() {
+            decoder.Feed(input.data(), input.size(), [&](const KeyEvent&) { ++keys; });
+            }, static_cast<double>(input.size()));
+
+        // Input thread to UI loop hand off, the eventfd wakeups included
+        Bench::Run("queue/spsc 100k events across threads", 5, [&]() {
+            const size_t count = 100000;
+            EventQueue& queue = EventQueue::Get();
+            std::thread producer([&]() {
+                for (size_t sent = 0; sent < count;) {
+                    if (queue.Push(event)) {
+                        ++sent;
+                    }
+                }
+                });
+            KeyEvent popped;
+            for (size_t received = 0; received < count; ++received) {
+                queue.WaitPop(popped);
+            }
+            producer.join();
+            });
+    }
+} // namespace Bench
+
+#endif /*QUEUEBENCH_H_*/
@@ -0,0 +1,42 @@
+#ifndef SPAWNBENCH_H_
+#define SPAWNBENCH_H_
+
+#include "Bench.h"
+#include "CLI.h"
+
+namespace Bench
+{
+    // The fork() + execvp() launcher CLI::RunCommand used before posix_spawn
+    int _ForkExec(const char* cmd) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            return -1;
+        }
+        if (pid == 0) {
+            char* argv[] = { const_cast<char*>(cmd), nullptr };
+            execvp(cmd, argv);
+            _exit(EXIT_FAILURE);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        return WEXITSTATUS(status);
+    }
+
+    void _SpawnRound(const std::string& suffix) {
+        Bench::Run("spawn/fork_exec true" + suffix, 200, []() { _ForkExec("true"); });
+        Bench::Run("spawn/posix_spawn true" + suffix, 200, []() {
+            Process::SpawnOptions options;
+            Process::Spawn("true", {}, options).Wait();
+            });
+        Bench::Run("spawn/RunCommand true" + suffix, 200, []() { CLI::RunCommand("true"); });
+    }
+
+    void SpawnBenchmarks() {
+        _SpawnRound("");
+        // fork() cost grows with the parent's mappings, vfork style spawning doesn't
+        std::vector<char> resident(256 << 20, 1);
+        _SpawnRound(" (256 MiB resident)");
+    }
+} // namespace Bench
+
+#endif /*SPAWNBENCH_H_*/
@@ -0,0 +1,135 @@
+#ifndef UIBENCH_H_
+#define UIBENCH_H_
+
+#include <cstdio>
+#include <string>
+
+#include "Bench.h"
+#include "Renderer.h"
+#include "Menu.h"
+#include "PacmanProgress.h"
+
+namespace Bench
+{
+    std::string _MenuLines(size_t count) {
+        std::string lines;
+        lines.reserve(count * 24);
+        for (size_t i = 0; i < count; ++i) {
+            lines += "Region/City_" + std::to_string(i) + "\n";
+        }
+        return lines;
+    }
+
+    void UIBenchmarks() {
+        // ncurses draws into /dev/null, the terminal is never touched
+        FILE* null = std::fopen("/dev/null", "w");
+        SCREEN* screen = newterm("xterm", null, stdin);
+        if (!screen) {
+            std::fprintf(stderr, "ui benchmarks skipped, no xterm terminfo\n");
+            return;
+        }
+        resizeterm(50, 160);
+
+        {
+            WINDOW* menuWin = newwin(50, 160, 0, 0);
+            WINDOW* menuSubWin = derwin(menuWin, 48, 158, 1, 1);
+            for (size_t count : { 1000, 10000, 100000, 1000000 }) {
+                std::string lines = _MenuLines(count);
+                std::string input;
+                Bench::RunWithSetup("menu/Init " + std::to_string(count) + " lines", count >= 1000000 ? 5 : 50,
+                    [&]() { input = lines; },
+                    [&]() {
+                        Menu menu(menuWin, menuSubWin);
+                        menu.Init(std::move(input));
+                    }, static_cast<double>(lines.size()));
+            }
+            delwin(menuSubWin);
+            delwin(menuWin);
+        }
+
+        {
+            // Every layer is drawn to each frame
+            Renderer renderer;
+            std::vector<WinHandle> layers;
+            for (int i = 0; i < 64; ++i) {
+                layers.push_back(renderer.CreateLayer(10, 40, i % 40, (i * 7) % 120));
+            }
+            int frame = 0;
+            Bench::Run("renderer/OnUpdate 64 dirty layers", 1000, [&]() {
+                for (WinHandle layer : layers) {
+                    mvwprintw(renderer.GetWindowPtr(layer), 1, 1, "frame %d", frame);
+                }
+                renderer.OnUpdate();
+                ++frame;
+                });
+            Bench::Run("renderer/OnUpdate 64 clean layers", 100000, [&]() { renderer.OnUpdate(); });
+            // Popup above the 64, as the progress view does it
+            Bench::Run("renderer/Create+Destroy popup over 64 layers", 100000, [&]() {
+                WinHandle popup = renderer.CreateLayer(6, 76, 20, 40);
+                renderer.ChangeLayerOrder(popup, 1);
+                renderer.DestroyLayer(popup);
+                });
+        }
+
+        {
+            // A held Down key over the timezone list, one frame per key against one per batch
+            Renderer renderer;
+            WinHandle main = renderer.CreateLayer(50, 160, 0, 0);
+            WinHandle sub = renderer.CreateSubLayer(main, 48, 158, 1, 1);
+            Menu menu(renderer.GetWindowPtr(main), renderer.GetWindowPtr(sub));
+            menu.Init(_MenuLines(600));
+            std::vector<KeyEvent> held(64, KeyEvent(Key::Down));
+            std::vector<KeyEvent> back(64, KeyEvent(Key::Up));
+            bool down = true;
+            Bench::Run("menu/OnEvent 64 held keys, frame per key", 200, [&]() {
+                for (const KeyEvent& event : down ? held : back) {
+                    if (menu.OnEvent(event)) {
+                        renderer.OnUpdate();
+                    }
+                }
+                down = !down;
+                });
+            Bench::Run("menu/OnEvents 64 held keys, frame per batch", 200, [&]() {
+                bool redraw = false;
+                menu.OnEvents((down ? held : back).data(), 64, redraw);
+                if (redraw) {
+                    renderer.OnUpdate();
+                }
+                down = !down;
+                });
+        }
+
+        {
+            // Piped pacstrap output for 1000 packages, lines as RunCommand hands them over
+            std::vector<std::string> transcript = { ":: Synchronizing package databases...", " core downloading...",
+                "resolving dependencies...", "Packages (1000) ...", "Total Download Size:   812.40 MiB",
+                ":: Retrieving packages..." };
+            for (int i = 0; i < 1000; ++i) {
+                transcript.push_back(" package" + std::to_string(i) + "-1.0-1-x86_64 downloading...");
+            }
+            transcript.push_back(":: Processing package changes...");
+            for (int i = 0; i < 1000; ++i) {
+                transcript.push_back("installing package" + std::to_string(i) + "...");
+            }
+            WINDOW* progressWin = newwin(6, 76, 0, 0);
+            Bench::Run("progress/Feed 2000 package lines", 1000, [&]() {
+                PacmanProgress progress;
+                for (const auto& line : transcript) {
+                    progress.Feed(line);
+                }
+                });
+            PacmanProgress progress;
+            for (size_t i = 0; i < transcript.size() / 2; ++i) {
+                progress.Feed(transcript[i]);
+            }
+            Bench::Run("progress/Draw", 100000, [&]() { progress.Draw(progressWin); });
+            delwin(progressWin);
+        }
+
+        endwin();
+        delscreen(screen);
+        std::fclose(null);
+    }
+} // namespace Bench
+
+#endif /*UIBENCH_H_*/
@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Bench.h"
+#include "SpawnBench.h"
+#include "CLIBench.h"
+#include "QueueBench.h"
+#include "UIBench.h"
+
+// Count every allocation for the allocs/op column
+void* operator new(size_t size) {
+    Bench::Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+int main(int argc, char const* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            Bench::GetOptions().json = true;
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            Bench::GetOptions().filter = argv[++i];
+        }
+        else {
+            std::fprintf(stderr, "Usage: %s [--json] [--filter substring]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Bench::SpawnBenchmarks();
+    Bench::CLIBenchmarks();
+    Bench::QueueBenchmarks();
+    Bench::UIBenchmarks();
+    return 0;
+}
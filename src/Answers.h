@@ -0,0 +1,71 @@
+#ifndef ANSWERS_H_
+#define ANSWERS_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <stdexcept>
+
+// Answers for an unattended run, one "key = value" per line
+// Keys may repeat (e.g. partition), lines starting with '#' are comments
+class Answers {
+public:
+    Answers() = default;
+
+    // Throws std::runtime_error if the file can't be read or a line has no '='
+    explicit Answers(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Failed to open answers file: " + path);
+        }
+        std::string line;
+        int number = 0;
+        while (std::getline(file, line)) {
+            ++number;
+            std::string trimmed = _Trim(line);
+            if (trimmed.empty() || trimmed[0] == '#') {
+                continue;
+            }
+            size_t equals = trimmed.find('=');
+            std::string key = _Trim(trimmed.substr(0, equals));
+            if (equals == std::string::npos || key.empty()) {
+                throw std::runtime_error(path + ":" + std::to_string(number) + ": expected key = value");
+            }
+            m_Values[key].push_back(_Trim(trimmed.substr(equals + 1)));
+        }
+    }
+
+    inline bool Has(const std::string& key) const { return m_Values.count(key) != 0; }
+
+    // Last value given for key, throws std::runtime_error if there is none
+    const std::string& Get(const std::string& key) const {
+        auto it = m_Values.find(key);
+        if (it == m_Values.end()) {
+            throw std::runtime_error("Answers file has no '" + key + "'");
+        }
+        return it->second.back();
+    }
+
+    // Every value of a repeated key in file order, empty if there is none
+    const std::vector<std::string>& GetAll(const std::string& key) const {
+        static const std::vector<std::string> none;
+        auto it = m_Values.find(key);
+        return it == m_Values.end() ? none : it->second;
+    }
+
+private:
+    static std::string _Trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+private:
+    std::map<std::string, std::vector<std::string>> m_Values;
+};
+
+#endif /*ANSWERS_H_*/
@@ -0,0 +1,122 @@
+#ifndef BLOCKDEVICES_H_
+#define BLOCKDEVICES_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Disk inventory read straight from sysfs
+namespace BlockDevices
+{
+    struct BlockDevice {
+        std::string name;       // Kernel name, the node is /dev/<name>
+        uint64_t size = 0;      // Bytes
+        bool rotational = false;
+        bool removable = false;
+        bool readOnly = false;
+        std::string model;      // Empty for partitions and virtual disks
+        int partitionNumber = 0;
+        std::vector<std::string> holders; // Device mapper, md, ... built on top
+        std::vector<BlockDevice> partitions;
+    };
+
+    // First line of a sysfs attribute, surrounding whitespace removed
+    std::string _ReadAttribute(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        std::string value;
+        std::getline(file, value);
+        size_t begin = value.find_first_not_of(" \t");
+        size_t end = value.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : value.substr(begin, end - begin + 1);
+    }
+
+    uint64_t _ReadNumber(const std::filesystem::path& path) {
+        std::string value = _ReadAttribute(path);
+        return value.empty() ? 0 : std::strtoull(value.c_str(), nullptr, 10);
+    }
+
+    // Attributes shared by disks and partitions, dir is the device's sysfs directory
+    BlockDevice _ReadDevice(const std::filesystem::path& dir, const std::filesystem::path& diskDir) {
+        namespace fs = std::filesystem;
+        BlockDevice device;
+        device.name = dir.filename().string();
+        device.size = _ReadNumber(dir / "size") * 512; // Always in 512 byte sectors
+        device.rotational = _ReadNumber(diskDir / "queue" / "rotational") != 0;
+        device.removable = _ReadNumber(diskDir / "removable") != 0;
+        device.readOnly = _ReadNumber(dir / "ro") != 0;
+
+        std::error_code ec;
+        for (fs::directory_iterator it(dir / "holders", ec), end; !ec && it != end; it.increment(ec)) {
+            device.holders.push_back(it->path().filename().string());
+        }
+        std::sort(device.holders.begin(), device.holders.end());
+        return device;
+    }
+
+    // Whole disks with their partitions, skipping loop, ram and empty devices
+    std::vector<BlockDevice> Scan(const std::string& sysRoot = "/sys") {
+        namespace fs = std::filesystem;
+        std::vector<BlockDevice> disks;
+        std::error_code ec;
+
+        for (fs::directory_iterator it(fs::path(sysRoot) / "block", ec), end; !ec && it != end; it.increment(ec)) {
+            const fs::path diskDir = it->path();
+            const std::string name = diskDir.filename().string();
+            if (name.rfind("loop", 0) == 0 || name.rfind("ram", 0) == 0 || name.rfind("zram", 0) == 0) {
+                continue;
+            }
+
+            BlockDevice disk = _ReadDevice(diskDir, diskDir);
+            if (disk.size == 0) {
+                continue; // No medium
+            }
+            disk.model = _ReadAttribute(diskDir / "device" / "model");
+
+            // Partitions are subdirectories carrying a partition number
+            std::error_code partEc;
+            for (fs::directory_iterator part(diskDir, partEc), partEnd; !partEc && part != partEnd; part.increment(partEc)) {
+                if (!fs::exists(part->path() / "partition", partEc)) {
+                    continue;
+                }
+                BlockDevice partition = _ReadDevice(part->path(), diskDir);
+                partition.partitionNumber = static_cast<int>(_ReadNumber(part->path() / "partition"));
+                disk.partitions.push_back(std::move(partition));
+            }
+            std::sort(disk.partitions.begin(), disk.partitions.end(),
+                [](const BlockDevice& a, const BlockDevice& b) { return a.partitionNumber < b.partitionNumber; });
+
+            disks.push_back(std::move(disk));
+        }
+
+        std::sort(disks.begin(), disks.end(),
+            [](const BlockDevice& a, const BlockDevice& b) { return a.name < b.name; });
+        return disks;
+    }
+
+    // Human readable size in lsblk's style, e.g. 465.8G
+    std::string FormatSize(uint64_t bytes) {
+        const char units[] = { 'B', 'K', 'M', 'G', 'T', 'P', 'E' };
+        double value = static_cast<double>(bytes);
+        size_t unit = 0;
+        while (value >= 1024.0 && unit < sizeof(units) - 1) {
+            value /= 1024.0;
+            ++unit;
+        }
+        char buffer[32];
+        int length = std::snprintf(buffer, sizeof(buffer), unit == 0 ? "%.0f" : "%.1f", value);
+        if (length > 2 && std::strcmp(buffer + length - 2, ".0") == 0) {
+            length -= 2; // Whole numbers go without the decimal, "1M"
+        }
+        buffer[length] = units[unit];
+        buffer[length + 1] = '\0';
+        return buffer;
+    }
+} // namespace BlockDevices
+
+#endif /*BLOCKDEVICES_H_*/
@@ -1,3 +1,6 @@
+#ifndef CLI_H_
+#define CLI_H_
+
 #include <iostream>
 #include <vector>
 #include <string>
@@ -15,70 +18,215 @@
 #include <signal.h>
 #include <cstring>
 #include <stdexcept>
+#include <functional>
+#include <string_view>
+#include <system_error>
+#include <sys/ioctl.h>
+#include <cctype>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <map>
+#include <mutex>
+
+#include "Process.h"
+#include "CommandScript.h"
+#include "InstallLog.h"
 
 namespace CLI
 {
+    // Splits on whitespace, single or double quotes keep blanks in one argument ("Arch OS")
     std::vector<std::string> _ParseArguments(const std::string& args) {
         std::vector<std::string> argList;
-        std::istringstream iss(args);
         std::string arg;
+        bool inArg = false;
+        char quote = 0;
 
-        while (iss >> arg) {
-            argList.push_back(arg);
+        for (char c : args) {
+            if (quote) {
+                if (c == quote) {
+                    quote = 0;
+                }
+                else {
+                    arg += c;
+                }
+            }
+            else if (c == '"' || c == '\'') {
+                quote = c;
+                inArg = true;
+            }
+            else if (std::isspace(static_cast<unsigned char>(c))) {
+                if (inArg) {
+                    argList.push_back(std::move(arg));
+                    arg.clear();
+                    inArg = false;
+                }
+            }
+            else {
+                arg += c;
+                inArg = true;
+            }
+        }
+        if (quote) {
+            throw std::invalid_argument("Unterminated quote in: " + args);
+        }
+        if (inArg) {
+            argList.push_back(std::move(arg));
         }
 
         return argList;
     }
 
-    std::string RunCommand(const char* cmd, const char* args = nullptr) {
-        int pipefd[2];
-        pid_t pid;
-        char buf;
-        std::string output;
+    // /bin/bash gets args as a single argument, everything else is split on whitespace
+    std::vector<std::string> _CommandArguments(const char* cmd, const char* args) {
+        if (strcmp(cmd, "/bin/bash") == 0) {
+            return args ? std::vector<std::string>{ args } : std::vector<std::string>{};
+        }
+        return _ParseArguments(args ? args : "");
+    }
 
-        if (pipe(pipefd) == -1) {
-            throw std::system_error(errno, std::system_category(), "Failed to create pipe");
+    // Called with every line (without the trailing newline) as soon as it is read
+    using LineCallback = std::function<void(std::string_view)>;
+
+    // Capture buffer grows by at least this much per read
+    constexpr size_t _CaptureChunk = 64 * 1024;
+    // Requested kernel pipe size, fewer wakeups for chatty children
+    constexpr int _PipeSize = 1024 * 1024;
+
+    // Reads fd until EOF straight into output's storage, one chunk per syscall
+    // The views handed to onLine are only valid during the call
+    // Every chunk is also handed to the install log under logSequence, waiting
+    // for room there rather than dropping, the child just blocks on its pipe
+    void _Capture(int fd, std::string& output, const LineCallback& onLine = nullptr, uint32_t logSequence = 0) {
+        size_t size = output.size();
+        size_t lineStart = size;
+
+        while (true) {
+            if (output.size() - size < _CaptureChunk) {
+                output.resize(std::max(output.size() * 2, size + _CaptureChunk));
+            }
+
+            ssize_t count = read(fd, &output[size], output.size() - size);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                output.resize(size);
+                throw std::system_error(errno, std::system_category(), "Failed to read from pipe");
+            }
+            if (count == 0) {
+                break;
+            }
+            InstallLog::Recorder::Get().Write(logSequence, output.data() + size, count, true);
+
+            if (onLine) {
+                const char* end = output.data() + size + count;
+                const char* pos = output.data() + size;
+                while (const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos))) {
+                    onLine(std::string_view(output.data() + lineStart, newline - output.data() - lineStart));
+                    lineStart = newline - output.data() + 1;
+                    pos = newline + 1;
+                }
+            }
+            size += count;
         }
 
-        pid = fork();
-        if (pid == -1) {
-            throw std::system_error(errno, std::system_category(), "Failed to fork");
+        if (onLine && lineStart < size) {
+            onLine(std::string_view(output.data() + lineStart, size - lineStart));
         }
+        output.resize(size);
+    }
 
-        if (pid == 0) { // Child process
-            close(pipefd[0]); // Close unused read end
-            dup2(pipefd[1], STDOUT_FILENO); // Redirect stdout to pipe
-            close(pipefd[1]); // Close write end
+    // /dev/null opened once for reading, a child's stdin when it must not read the terminal
+    // Might throw std::system_error if it can't be opened
+    int NullInput() {
+        static int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::system_error(errno, std::system_category(), "Failed to open /dev/null");
+        }
+        return fd;
+    }
 
-            // Parse args and prepare for execvp execpt from /bin/bash
-            if (strcmp(cmd, "/bin/bash") != 0) {
-                std::vector<std::string> argList = _ParseArguments(args ? args : "");
+    // Read end of a pipe that already holds input followed by EOF, to hand to
+    // RunCommand as a child's stdin, so the input never touches the disk.
+    // The input has to fit in the pipe buffer, the caller closes the fd.
+    // Might throw std::system_error or std::length_error
+    int InputPipe(std::string_view input) {
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            throw std::system_error(errno, std::system_category(), "Failed to create pipe");
+        }
+        if (static_cast<size_t>(fcntl(pipefd[1], F_GETPIPE_SZ)) < input.size()) {
+            fcntl(pipefd[1], F_SETPIPE_SZ, static_cast<int>(std::min<size_t>(input.size(), _PipeSize)));
+        }
+        if (static_cast<size_t>(fcntl(pipefd[1], F_GETPIPE_SZ)) < input.size()) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            throw std::length_error("Input doesn't fit in a pipe");
+        }
+        size_t written = 0;
+        while (written < input.size()) {
+            ssize_t count = write(pipefd[1], input.data() + written, input.size() - written);
+            if (count < 0 && errno != EINTR) {
+                int error = errno;
+                close(pipefd[0]);
+                close(pipefd[1]);
+                throw std::system_error(error, std::system_category(), "Failed to write to pipe");
+            }
+            written += count > 0 ? count : 0;
+        }
+        close(pipefd[1]); // The child sees EOF after the input
+        return pipefd[0];
+    }
 
-                // Convert to char* array for execvp
-                std::vector<char*> argv;
-                argv.push_back(const_cast<char*>(cmd));
-                for (auto& a : argList) {
-                    argv.push_back(&a[0]);
-                }
-                argv.push_back(nullptr);
+    // result, if given, receives the exit status, wall time and rusage
+    // mergeStderr captures stderr too, for children that must stay off the screen
+    // inputFd, if given, becomes the child's stdin, it stays open for the caller
+    std::string RunCommand(const char* cmd, const char* args = nullptr, const LineCallback& onLine = nullptr,
+        Process::Result* result = nullptr, bool mergeStderr = false, int inputFd = -1) {
+        int pipefd[2];
+        std::string output;
 
-                execvp(cmd, argv.data());
+        // Close-on-exec so concurrently spawned children don't hold the write end
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            throw std::system_error(errno, std::system_category(), "Failed to create pipe");
+        }
+        fcntl(pipefd[0], F_SETPIPE_SZ, _PipeSize); // Best effort, the default size still works
+
+        Process::Child child;
+        try {
+            Process::SpawnOptions options;
+            options.Dup2(pipefd[1], STDOUT_FILENO); // Redirect stdout to pipe
+            if (mergeStderr) {
+                options.Dup2(pipefd[1], STDERR_FILENO);
             }
-            else {
-                execl(cmd, cmd, args, nullptr);
+            if (inputFd != -1) {
+                options.Dup2(inputFd, STDIN_FILENO);
             }
-            // execvp only returns on error
-            _exit(EXIT_FAILURE);
+            child = Process::Spawn(cmd, _CommandArguments(cmd, args), options);
         }
-        else { // Parent process
-            close(pipefd[1]); // Close unused write end
+        catch (...) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+            throw;
+        }
+        close(pipefd[1]); // Only the child writes
 
-            while (read(pipefd[0], &buf, 1) > 0) {
-                output += buf;
-            }
+        InstallLog::Recorder& log = InstallLog::Recorder::Get();
+        uint32_t logSequence = log.IsEnabled() ? log.Begin(std::string(cmd) + " " + (args ? args : "")) : 0;
+        try {
+            _Capture(pipefd[0], output, onLine, logSequence);
+        }
+        catch (...) {
+            close(pipefd[0]);
+            log.End(logSequence, child.Wait());
+            throw;
+        }
 
-            close(pipefd[0]); // Close read end
-            wait(nullptr); // Wait for child process
+        close(pipefd[0]); // Close read end
+        Process::Result status = child.Wait();
+        log.End(logSequence, status);
+        if (result) {
+            *result = status;
         }
 
         return output;
@@ -105,87 +253,195 @@ namespace CLI
         tcsetattr(fd, TCSAFLUSH, &raw);
     }
 
-    int RunInteractiveCommand(const char* cmd, const char* arg = nullptr) {
-        pid_t pid;
-        int master_fd;
+    // Bytes moved per read, pacman's progress output arrives in large bursts
+    constexpr size_t _RelayChunk = 64 * 1024;
 
-        // Set the terminal to raw mode
-        struct termios original;
-        _SetRawMode(STDIN_FILENO, &original);
-
-        // Create a pseudo-terminal
-        pid = forkpty(&master_fd, NULL, NULL, NULL);
-
-        if (pid < 0) {
-            std::ostringstream msg;
-            msg << "Failed to fork at line " << __LINE__ << " in function " << __FILE__;
-            throw std::system_error(errno, std::system_category(), msg.str());
+    // Writes everything, waiting out EINTR and a non blocking fd being full
+    bool _WriteAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written > 0) {
+                data += written;
+                size -= written;
+            }
+            else if (errno == EAGAIN) {
+                struct pollfd out = { fd, POLLOUT, 0 };
+                poll(&out, 1, -1);
+            }
+            else if (errno != EINTR) {
+                return false;
+            }
         }
+        return true;
+    }
 
-        if (pid == 0) { // Child process
-            // Parse args and prepare for execvp
-            std::vector<std::string> argList = _ParseArguments(arg ? arg : "");
+    // Write end of the self-pipe the SIGWINCH handler writes to
+    inline int _WinchPipe = -1;
 
-            // Convert to char* array for execvp
-            std::vector<char*> argv;
-            argv.push_back(const_cast<char*>(cmd));
-            for (auto& a : argList) {
-                argv.push_back(&a[0]);
-            }
-            argv.push_back(nullptr);
+    void _OnWinch(int) {
+        int saved = errno;
+        char byte = 0;
+        write(_WinchPipe, &byte, 1); // A full pipe already has a resize pending
+        errno = saved;
+    }
 
-            execvp(cmd, argv.data());
-            // execvp only returns on error
-            std::ostringstream msg;
-            msg << "Failed to execute command " << cmd << " " << arg <<
-                " at line " << __LINE__ << " in function " << __FILE__;
-            throw std::system_error(errno, std::system_category(), msg.str());
-            exit(EXIT_FAILURE);
-        }
-        else { // Parent process
-            char buffer[256];
-            ssize_t bytes_read;
-            fd_set read_fds;
-            int max_fd = std::max(STDIN_FILENO, master_fd) + 1;
-
-            while (true) {
-                FD_ZERO(&read_fds);
-                FD_SET(STDIN_FILENO, &read_fds);
-                FD_SET(master_fd, &read_fds);
-
-                int activity = select(max_fd, &read_fds, NULL, NULL, NULL);
-
-                if (activity < 0 && errno != EINTR) {
-                    std::cerr << "Select error\n";
-                    break;
+    // Copies the child's output to stdout and stdin to the child until the child
+    // closes the slave, passing our window size on whenever it changes
+    // The output also goes to the install log under logSequence, the input doesn't
+    void _RelayPty(int master, uint32_t logSequence = 0) {
+        int winch[2];
+        if (pipe2(winch, O_CLOEXEC | O_NONBLOCK) == -1) {
+            throw std::system_error(errno, std::system_category(), "Failed to create pipe");
+        }
+        int epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll == -1) {
+            int error = errno;
+            close(winch[0]);
+            close(winch[1]);
+            throw std::system_error(error, std::system_category(), "Failed to create epoll");
+        }
+        auto watch = [epoll](int fd) {
+            struct epoll_event event {};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            return epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+            };
+        watch(master);
+        watch(winch[0]);
+        // Regular files and /dev/null can't be watched, the child gets no input then
+        watch(STDIN_FILENO);
+
+        _WinchPipe = winch[1];
+        struct sigaction action {};
+        struct sigaction previous;
+        action.sa_handler = _OnWinch;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGWINCH, &action, &previous);
+
+        char buffer[_RelayChunk];
+        struct epoll_event events[4];
+        bool running = true;
+        while (running) {
+            int count = epoll_wait(epoll, events, 4, -1);
+            if (count == -1) {
+                if (errno == EINTR) {
+                    continue;
                 }
-
-                if (FD_ISSET(master_fd, &read_fds)) { // Data from the child process
-                    bytes_read = read(master_fd, buffer, sizeof(buffer) - 1);
-                    if (bytes_read <= 0) {
-                        break; // Child process has terminated or an error occurred
+                break;
+            }
+            for (int i = 0; i < count && running; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == master) { // Data from the child process, EIO once it is gone
+                    ssize_t bytes = read(master, buffer, sizeof(buffer));
+                    if (bytes > 0) {
+                        InstallLog::Recorder::Get().Write(logSequence, buffer, bytes);
+                        running = _WriteAll(STDOUT_FILENO, buffer, bytes);
+                    }
+                    else if (bytes == 0 || errno != EINTR) {
+                        running = false;
                     }
-                    buffer[bytes_read] = '\0';
-                    std::cout << buffer << std::flush;
                 }
-
-                if (FD_ISSET(STDIN_FILENO, &read_fds)) { // Data from the user
-                    bytes_read = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
-                    if (bytes_read > 0) {
-                        buffer[bytes_read] = '\0';
-                        write(master_fd, buffer, bytes_read); // Send user input to the child process
+                else if (fd == STDIN_FILENO) { // Data from the user
+                    ssize_t bytes = read(STDIN_FILENO, buffer, sizeof(buffer));
+                    if (bytes > 0) {
+                        _WriteAll(master, buffer, bytes);
+                    }
+                    else if (bytes == 0 || errno != EINTR) {
+                        // Nothing more to forward, keep relaying the output
+                        epoll_ctl(epoll, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+                    }
+                }
+                else { // Resized, the kernel signals the child's foreground group
+                    while (read(winch[0], buffer, sizeof(buffer)) > 0) {
+                    }
+                    struct winsize size;
+                    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == 0 || ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+                        ioctl(master, TIOCSWINSZ, &size);
                     }
                 }
             }
+        }
+
+        sigaction(SIGWINCH, &previous, nullptr);
+        _WinchPipe = -1;
+        close(epoll);
+        close(winch[0]);
+        close(winch[1]);
+    }
 
-            // Wait for the child process to finish
-            int status;
-            waitpid(pid, &status, 0);
+    int RunInteractiveCommand(const char* cmd, const char* arg = nullptr, Process::Result* result = nullptr) {
+        // Create a pseudo-terminal
+        int master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        char slaveName[64];
+        if (master_fd == -1 || grantpt(master_fd) == -1 || unlockpt(master_fd) == -1 ||
+            ptsname_r(master_fd, slaveName, sizeof(slaveName)) != 0) {
+            int error = errno;
+            if (master_fd != -1) {
+                close(master_fd);
+            }
+            std::ostringstream msg;
+            msg << "Failed to create pty at line " << __LINE__ << " in function " << __FILE__;
+            throw std::system_error(error, std::system_category(), msg.str());
+        }
+
+        // The child starts with the size of our terminal
+        struct winsize size;
+        if (ioctl(STDIN_FILENO, TIOCGWINSZ, &size) == 0) {
+            ioctl(master_fd, TIOCSWINSZ, &size);
+        }
+
+        Process::Child child;
+        try {
+            // New session, so opening the slave makes it the controlling terminal
+            Process::SpawnOptions options;
+            options.NewSession();
+            options.Open(STDIN_FILENO, slaveName, O_RDWR);
+            options.Dup2(STDIN_FILENO, STDOUT_FILENO);
+            options.Dup2(STDIN_FILENO, STDERR_FILENO);
+            child = Process::Spawn(cmd, _ParseArguments(arg ? arg : ""), options);
+        }
+        catch (...) {
             close(master_fd);
-            // Restore the terminal settings
+            throw;
+        }
+
+        // Set the terminal to raw mode, stdin might not be a terminal at all
+        struct termios original;
+        bool terminal = isatty(STDIN_FILENO);
+        if (terminal) {
+            _SetRawMode(STDIN_FILENO, &original);
+        }
+
+        // A child that failed to exec never opened the slave, nothing to relay
+        InstallLog::Recorder& log = InstallLog::Recorder::Get();
+        uint32_t logSequence = log.IsEnabled() ? log.Begin(std::string(cmd) + " " + (arg ? arg : "")) : 0;
+        if (child.GetPid() > 0) {
+            try {
+                _RelayPty(master_fd, logSequence);
+            }
+            catch (...) {
+                close(master_fd);
+                if (terminal) {
+                    tcsetattr(STDIN_FILENO, TCSANOW, &original);
+                }
+                log.End(logSequence, child.Wait());
+                throw;
+            }
+        }
+
+        // Wait for the child process to finish
+        close(master_fd);
+        // Restore the terminal settings
+        if (terminal) {
             tcsetattr(STDIN_FILENO, TCSANOW, &original);
-            return WEXITSTATUS(status);
         }
+        Process::Result status = child.Wait();
+        log.End(logSequence, status);
+        if (result) {
+            *result = status;
+        }
+        return status.signal != 0 ? 128 + status.signal : status.exitCode;
     }
 
     std::string _GetExeDir() {
@@ -212,79 +468,38 @@ namespace CLI
     }
 
 
-    bool _IsStepLine(const std::string& line) {
-        if (line.rfind("#", 0) != 0) {
-            return false;
-        }
-        std::stringstream ss(line.substr(1)); // Exclude '#'
-        int num;
-        char dot;
-        ss >> num >> dot;
-        return ss && dot == '.' && num > 0; // Check if it's a step line
-    }
-
-    std::vector<std::vector<std::string>> ParseCommands(int stepNumber) {
-        std::string filePath = _GetExeDir() + "/Commands";
-        std::vector<std::vector<std::string>> commands;
-        std::ifstream file(filePath);
-        std::string line;
-        bool startCapture = false;
-
-        if (file.is_open()) {
-            while (std::getline(file, line)) {
-                if (line.rfind("#", 0) == 0) {
-                    if (_IsStepLine(line)) {
-                        if (startCapture) {
-                            // If it's another step line, stop capturing
-                            break;
-                        }
-                        else if (line.find("# " + std::to_string(stepNumber) + ".") == 0) {
-                            // If it's the starting step line, start capturing
-                            startCapture = true;
-                            continue;
-                        }
-                    }
-                    // Ignore other comments
-                    continue;
-                }
-
-                if (startCapture && !line.empty()) {
-                    std::istringstream iss(line);
-                    std::string command, rest;
-                    iss >> command;
-                    getline(iss, rest);
-                    if (!rest.empty() && rest[0] == ' ') {
-                        rest.erase(0, 1); // Remove the leading space
-                    }
-                    commands.push_back({ command, rest });
-                }
+    // The Commands file next to the executable, mapped on first use
+    const CommandScript* _DefaultScript() {
+        static std::unique_ptr<CommandScript> script = []() -> std::unique_ptr<CommandScript> {
+            try {
+                return std::make_unique<CommandScript>(_GetExeDir() + "/Commands");
             }
-            file.close();
-        }
-        else {
-            std::cerr << "Unable to open file: " << filePath << std::endl;
-        }
+            catch (const std::system_error& e) {
+                std::cerr << e.what() << std::endl;
+                return nullptr;
+            }
+            }();
+        return script.get();
+    }
 
-        return commands;
+    // Views stay valid for the life of the program
+    CommandScript::StepView ParseCommands(int stepNumber) {
+        const CommandScript* script = _DefaultScript();
+        return script ? script->GetStep(stepNumber) : CommandScript::StepView();
     }
 
-    std::string ExtractDiskOrPartitionName(const std::string& line) {
-        // Check if the line starts with '|', '`'
-        if (line[0] == '|' || line[0] == '`') {
-            // For partitions, remove the leading '|-' or '`-'
-            size_t start = line.find_first_not_of("|`-");
-            size_t end = line.find(' ', start); // Find the end of the partition name
-            if (end == std::string::npos) {
-                end = line.length(); // If there's no space, use the length of the line
-            }
-            return line.substr(start, end - start);
-        }
-        else {
-            // It's a disk name; extract the first word
-            std::istringstream iss(line);
-            std::string diskName;
-            iss >> diskName;
-            return diskName;
+    // Same for a script at any path, each one is mapped on first use and kept
+    // Might throw std::system_error if the script can't be opened
+    CommandScript::StepView ParseCommands(const std::string& scriptPath, int stepNumber) {
+        static std::mutex mutex;
+        static std::map<std::string, std::unique_ptr<CommandScript>> scripts;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<CommandScript>& script = scripts[scriptPath];
+        if (!script) {
+            script = std::make_unique<CommandScript>(scriptPath);
         }
+        return script->GetStep(stepNumber);
     }
 } // namespace CLI
+
+#endif /*CLI_H_*/
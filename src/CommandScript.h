@@ -0,0 +1,183 @@
+#ifndef COMMANDSCRIPT_H_
+#define COMMANDSCRIPT_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// One command line of the script, both views point into the mapping
+struct CommandRecord {
+    std::string_view command;
+    std::string_view args;
+    int group = 0; // Commands sharing a non zero group may run in parallel
+};
+
+// The Commands file mapped once and indexed by step in a single pass
+// Steps start at lines like "# 2. Install packages", commands between
+// "# parallel" and "# end parallel" form a group, other comments are ignored
+class CommandScript {
+public:
+    // Contiguous records of one step
+    struct StepView {
+        const CommandRecord* first = nullptr;
+        const CommandRecord* last = nullptr;
+
+        inline const CommandRecord* begin() const { return first; }
+        inline const CommandRecord* end() const { return last; }
+        inline size_t size() const { return last - first; }
+        inline bool empty() const { return first == last; }
+    };
+
+    CommandScript() = default;
+
+    // Throws std::system_error if the file can't be opened or mapped
+    explicit CommandScript(const std::string& filePath) {
+        int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            throw std::system_error(errno, std::system_category(), "Unable to open file: " + filePath);
+        }
+        struct stat info;
+        if (fstat(fd, &info) == -1) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::system_category(), "Unable to stat file: " + filePath);
+        }
+        m_Size = static_cast<size_t>(info.st_size);
+        if (m_Size > 0) {
+            void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                close(fd);
+                throw std::system_error(error, std::system_category(), "Unable to map file: " + filePath);
+            }
+            m_Data = static_cast<const char*>(data);
+        }
+        close(fd); // The mapping stays valid
+        _Index();
+    }
+
+    ~CommandScript() {
+        if (m_Data) {
+            munmap(const_cast<char*>(m_Data), m_Size);
+        }
+    }
+
+    CommandScript(const CommandScript&) = delete;
+    CommandScript& operator=(const CommandScript&) = delete;
+
+    // Empty if the step doesn't exist
+    StepView GetStep(int stepNumber) const {
+        auto it = m_Steps.find(stepNumber);
+        if (it == m_Steps.end()) {
+            return StepView();
+        }
+        return StepView{ m_Records.data() + it->second.first, m_Records.data() + it->second.second };
+    }
+
+    inline size_t GetStepCount() const { return m_Steps.size(); }
+
+private:
+    // "#", optional blanks, a positive number and a dot
+    static bool _StepNumber(std::string_view line, int& number) {
+        size_t pos = 1;
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) {
+            ++pos;
+        }
+        size_t digits = pos;
+        number = 0;
+        while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9' && pos - digits < 9) {
+            number = number * 10 + (line[pos] - '0');
+            ++pos;
+        }
+        return pos > digits && pos < line.size() && line[pos] == '.' && number > 0;
+    }
+
+    // Comment text without the '#' and surrounding blanks
+    static std::string_view _CommentText(std::string_view line) {
+        size_t begin = line.find_first_not_of(" \t", 1);
+        if (begin == std::string_view::npos) {
+            return std::string_view();
+        }
+        size_t end = line.find_last_not_of(" \t");
+        return line.substr(begin, end - begin + 1);
+    }
+
+    void _Index() {
+        std::string_view text(m_Data ? m_Data : "", m_Size);
+        int current = 0; // Lines before the first step belong to no step
+        size_t stepStart = 0;
+        int groups = 0;
+        int group = 0;
+
+        auto closeStep = [&]() {
+            if (current > 0) {
+                // The first occurrence of a step number wins
+                m_Steps.emplace(current, std::make_pair(stepStart, m_Records.size()));
+            }
+        };
+
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos) {
+                end = text.size();
+            }
+            std::string_view line = text.substr(pos, end - pos);
+            pos = end + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            if (!line.empty() && line[0] == '#') {
+                int number;
+                if (_StepNumber(line, number)) {
+                    closeStep();
+                    current = number;
+                    stepStart = m_Records.size();
+                    group = 0; // Groups don't span steps
+                }
+                else if (_CommentText(line) == "parallel") {
+                    group = ++groups;
+                }
+                else if (_CommentText(line) == "end parallel") {
+                    group = 0;
+                }
+                continue;
+            }
+            if (current == 0) {
+                continue;
+            }
+
+            // "command rest of the line", one separating space is dropped
+            size_t commandStart = line.find_first_not_of(" \t");
+            if (commandStart == std::string_view::npos) {
+                continue;
+            }
+            size_t commandEnd = line.find_first_of(" \t", commandStart);
+            CommandRecord record;
+            record.group = group;
+            record.command = line.substr(commandStart, commandEnd == std::string_view::npos ? std::string_view::npos : commandEnd - commandStart);
+            if (commandEnd != std::string_view::npos) {
+                record.args = line.substr(commandEnd + (line[commandEnd] == ' ' ? 1 : 0));
+            }
+            m_Records.push_back(record);
+        }
+        closeStep();
+    }
+
+private:
+    const char* m_Data = nullptr;
+    size_t m_Size = 0;
+    std::vector<CommandRecord> m_Records;
+    // Step number to its [begin, end) range in m_Records
+    std::map<int, std::pair<size_t, size_t>> m_Steps;
+};
+
+#endif /*COMMANDSCRIPT_H_*/
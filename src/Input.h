@@ -5,15 +5,22 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <signal.h>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <cstring>
 #include <functional>
+#include <cerrno>
+
+#include "KeyDecoder.h"
 
 
 class InputHandler {
 public:
+    // How long a lone ESC waits for the rest of a sequence
+    static constexpr long EscapeTimeoutUs = 25000;
+
     InputHandler() = default;
     void Init() {
         // Save current terminal settings
@@ -31,6 +38,21 @@ public:
         int flags = fcntl(m_PipeFds[0], F_GETFL, 0);
         fcntl(m_PipeFds[0], F_SETFL, flags | O_NONBLOCK);
 
+        // SIGWINCH comes in as a Key::Resize between the keys, before ncurses
+        // is initialized so it keeps its hands off the signal
+        if (pipe(m_WinchFds) == 0) {
+            for (int fd : m_WinchFds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+            _WinchWriteFd = m_WinchFds[1];
+            struct sigaction action = {};
+            action.sa_handler = _OnWinch;
+            action.sa_flags = SA_RESTART; // Blocking reads on other threads must not fail with EINTR
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGWINCH, &action, &m_OrigWinch);
+        }
+
         // Start the input thread
         m_InputThread = std::thread(&InputHandler::_InputThread, this);
     }
@@ -44,6 +66,10 @@ public:
             m_InputThread.join();
         }
 
+        if (m_WinchFds[0] != -1) {
+            sigaction(SIGWINCH, &m_OrigWinch, nullptr);
+            _WinchWriteFd = -1;
+        }
         _ClosePipe();
         _RestoreTerminal();
     }
@@ -54,7 +80,8 @@ public:
         m_Mutex.unlock();
     }
 
-    void SetCallback(std::function<bool(char*)> callback) {
+    // Called on the input thread once per key, in the order they were typed
+    void SetCallback(std::function<bool(const KeyEvent&)> callback) {
         m_Callback = callback;
     }
 
@@ -72,6 +99,14 @@ public:
     }
 
 private:
+    static void _OnWinch(int) {
+        int saved = errno;
+        if (_WinchWriteFd != -1) {
+            write(_WinchWriteFd, "w", 1); // Full pipe already holds a resize
+        }
+        errno = saved;
+    }
+
     void _InputThread() {
         while (true) {
             {
@@ -87,28 +122,51 @@ private:
 
     bool _ProcessInput() {
         fd_set read_fds;
-        char buffer[10] = { 0 };
-        int max_fd = std::max(STDIN_FILENO, m_PipeFds[0]) + 1;
+        char buffer[256]; // A held key or a paste delivers many keys per read
+        int max_fd = std::max({ STDIN_FILENO, m_PipeFds[0], m_WinchFds[0] }) + 1;
 
         FD_ZERO(&read_fds);
         FD_SET(STDIN_FILENO, &read_fds);
         FD_SET(m_PipeFds[0], &read_fds);
+        if (m_WinchFds[0] != -1) {
+            FD_SET(m_WinchFds[0], &read_fds);
+        }
 
-        int activity = select(max_fd, &read_fds, nullptr, nullptr, nullptr);
+        // A pending ESC is a key of its own if nothing follows it in time
+        struct timeval timeout = { 0, EscapeTimeoutUs };
+        int activity = select(max_fd, &read_fds, nullptr, nullptr, m_Decoder.HasPending() ? &timeout : nullptr);
 
         if (activity < 0) {
+            if (errno == EINTR) {
+                return true;
+            }
             perror("select");
             return false;
         }
 
+        auto emit = [this](const KeyEvent& event) {
+            if (m_Callback) {
+                m_Callback(event);
+            }
+            };
+        if (activity == 0) {
+            m_Decoder.Flush(emit);
+            return true;
+        }
+
         if (FD_ISSET(STDIN_FILENO, &read_fds)) {
             ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
-            if (count > 0 && m_Callback) {
-                m_Callback(buffer);
-                memset(buffer, 0, sizeof(buffer));
+            if (count > 0) {
+                m_Decoder.Feed(buffer, static_cast<size_t>(count), emit);
             }
         }
 
+        if (m_WinchFds[0] != -1 && FD_ISSET(m_WinchFds[0], &read_fds)) {
+            // Any number of signals is one relayout
+            while (read(m_WinchFds[0], buffer, sizeof(buffer)) > 0) {}
+            emit(KeyEvent(Key::Resize));
+        }
+
         if (FD_ISSET(m_PipeFds[0], &read_fds)) {
             return false;
         }
@@ -129,15 +187,23 @@ private:
     void _ClosePipe() {
         close(m_PipeFds[0]);
         close(m_PipeFds[1]);
+        if (m_WinchFds[0] != -1) {
+            close(m_WinchFds[0]);
+            close(m_WinchFds[1]);
+        }
     }
 
 private:
     int m_PipeFds[2];
+    int m_WinchFds[2] = { -1, -1 };
+    struct sigaction m_OrigWinch;
+    static inline volatile sig_atomic_t _WinchWriteFd = -1;
     std::thread m_InputThread;
     std::mutex m_Mutex;
     std::condition_variable m_CondVar;
     struct termios m_OrigTermios;
-    std::function<bool(char*)> m_Callback = nullptr;
+    std::function<bool(const KeyEvent&)> m_Callback = nullptr;
+    KeyDecoder m_Decoder; // Input thread only
     bool m_Paused = false;
 };
 
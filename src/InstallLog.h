@@ -0,0 +1,359 @@
+#ifndef INSTALLLOG_H_
+#define INSTALLLOG_H_
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <zlib.h>
+
+#include "Process.h"
+
+// Copy of every child's output in gzip segments, with an index of where each
+// command starts and ends. Producers only claim a slot in a lock-free ring, the
+// compression and file I/O run on a writer thread that sleeps on an eventfd
+// while the ring is empty. Captured children wait a bounded time for room, so
+// they are slowed down through their pipe instead of losing output.
+namespace InstallLog
+{
+    class Recorder {
+    public:
+        static constexpr size_t SlotBytes = 4096;
+        static constexpr size_t Capacity = 4096;            // 16 MiB in flight
+        static constexpr long SegmentBytes = 4 * 1024 * 1024; // Compressed size of one segment
+        static constexpr unsigned MaxSegments = 8;          // Older segments are deleted
+        static constexpr std::chrono::seconds MaxWait{ 2 }; // Longest a waiting Write blocks on a full ring
+
+        static inline Recorder& Get() {
+            static Recorder instance;
+            return instance;
+        }
+
+        ~Recorder() {
+            Stop();
+        }
+
+        // Returns false if dir can't be created or the first segment can't be opened
+        bool Start(const std::string& dir) {
+            if (IsEnabled()) {
+                return true;
+            }
+            std::error_code error;
+            std::filesystem::create_directories(dir, error);
+            m_Dir = dir;
+            m_Index = std::fopen((m_Dir + "/install.idx").c_str(), "w");
+            m_Wake = eventfd(0, EFD_CLOEXEC);
+            if (!m_Index || m_Wake == -1 || !_OpenSegment(0)) {
+                if (m_Index) {
+                    std::fclose(m_Index);
+                    m_Index = nullptr;
+                }
+                if (m_Wake != -1) {
+                    close(m_Wake);
+                    m_Wake = -1;
+                }
+                return false;
+            }
+            m_Slots.reset(new _Slot[Capacity]);
+            for (size_t i = 0; i < Capacity; ++i) {
+                m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            m_Head.store(0, std::memory_order_relaxed);
+            m_Tail = 0;
+            m_Stopping.store(false, std::memory_order_relaxed);
+            m_Idle.store(false, std::memory_order_relaxed);
+            m_Writer = std::thread(&Recorder::_WriterLoop, this);
+            m_Enabled.store(true, std::memory_order_release);
+            return true;
+        }
+
+        // Drains what is queued, then closes the files. A copy goes to
+        // /mnt/var/log when the new system has one by then.
+        void Stop() {
+            if (!m_Enabled.exchange(false, std::memory_order_acq_rel)) {
+                return;
+            }
+            m_Stopping.store(true, std::memory_order_release);
+            _Wake();
+            m_Writer.join();
+            close(m_Wake);
+            m_Wake = -1;
+            std::fprintf(m_Index, "-\tdropped\t%u\t%ld\t%zu bytes\n", m_Segment, m_SegmentOffset,
+                m_Dropped.load(std::memory_order_relaxed));
+            std::fclose(m_Index);
+            gzclose(m_File);
+            m_Index = nullptr;
+            m_File = nullptr;
+
+            std::error_code error;
+            if (std::filesystem::is_directory("/mnt/var/log", error)) {
+                std::filesystem::copy(m_Dir, "/mnt/var/log/arch-installer",
+                    std::filesystem::copy_options::recursive | std::filesystem::copy_options::overwrite_existing, error);
+            }
+        }
+
+        inline bool IsEnabled() const {
+            return m_Enabled.load(std::memory_order_acquire);
+        }
+
+        // Sequence number for the command's output, 0 when logging is off
+        uint32_t Begin(std::string_view command) {
+            if (!IsEnabled()) {
+                return 0;
+            }
+            uint32_t sequence = m_Next.fetch_add(1, std::memory_order_relaxed);
+            _PushWaiting(_Kind::Begin, sequence, command.data(), std::min(command.size(), SlotBytes));
+            return sequence;
+        }
+
+        // Bytes that don't fit in the ring are counted and dropped. With wait set
+        // it first waits up to MaxWait for the writer to make room, for callers
+        // whose child can simply be slowed down, like a captured pipe.
+        void Write(uint32_t sequence, const char* data, size_t size, bool wait = false) {
+            if (sequence == 0 || !IsEnabled()) {
+                return;
+            }
+            while (size > 0) {
+                size_t chunk = std::min(size, SlotBytes);
+                if (!(wait ? _PushWaiting(_Kind::Data, sequence, data, chunk) : _Push(_Kind::Data, sequence, data, chunk))) {
+                    m_Dropped.fetch_add(size, std::memory_order_relaxed);
+                    return;
+                }
+                data += chunk;
+                size -= chunk;
+            }
+        }
+
+        void End(uint32_t sequence, const Process::Result& result) {
+            if (sequence == 0 || !IsEnabled()) {
+                return;
+            }
+            char status[32];
+            int length = result.signal != 0 ? std::snprintf(status, sizeof(status), "signal %d", result.signal)
+                : std::snprintf(status, sizeof(status), "exit %d", result.exitCode);
+            _PushWaiting(_Kind::End, sequence, status, static_cast<size_t>(length));
+        }
+
+        inline size_t GetDropped() const {
+            return m_Dropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        enum class _Kind : uint32_t { Begin, Data, End };
+
+        // Bounded MPSC ring, a slot is free for position p when its sequence is p
+        // and readable when it is p + 1
+        struct _Slot {
+            std::atomic<size_t> sequence;
+            _Kind kind;
+            uint32_t command;
+            uint32_t size;
+            char data[SlotBytes];
+        };
+
+        Recorder() = default;
+
+        bool _Push(_Kind kind, uint32_t command, const char* data, size_t size) {
+            size_t position = m_Head.load(std::memory_order_relaxed);
+            _Slot* slot;
+            while (true) {
+                slot = &m_Slots[position % Capacity];
+                size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0) {
+                    if (m_Head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (difference < 0) {
+                    return false; // Full, the writer is behind
+                }
+                else {
+                    position = m_Head.load(std::memory_order_relaxed);
+                }
+            }
+            slot->kind = kind;
+            slot->command = command;
+            slot->size = static_cast<uint32_t>(size);
+            std::memcpy(slot->data, data, size);
+            slot->sequence.store(position + 1, std::memory_order_release);
+
+            // Pairs with the fence in _WriterLoop, either the writer sees this
+            // record before sleeping or this sees it idle and wakes it
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_Idle.load(std::memory_order_relaxed) && m_Idle.exchange(false, std::memory_order_relaxed)) {
+                _Wake();
+            }
+            return true;
+        }
+
+        // _Push, waiting up to MaxWait for the writer when the ring is full
+        bool _PushWaiting(_Kind kind, uint32_t command, const char* data, size_t size) {
+            auto deadline = std::chrono::steady_clock::now() + MaxWait;
+            while (!_Push(kind, command, data, size)) {
+                std::unique_lock<std::mutex> lock(m_SpaceMutex);
+                m_SpaceWaiters.fetch_add(1, std::memory_order_seq_cst);
+                bool space = m_SpaceFreed.wait_until(lock, deadline, [this]() { return _HasSpace(); });
+                m_SpaceWaiters.fetch_sub(1, std::memory_order_relaxed);
+                if (!space) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline bool _HasSpace() const {
+            size_t position = m_Head.load(std::memory_order_relaxed);
+            return m_Slots[position % Capacity].sequence.load(std::memory_order_acquire) == position;
+        }
+
+        inline bool _IsReadable() const {
+            return m_Slots[m_Tail % Capacity].sequence.load(std::memory_order_acquire) == m_Tail + 1;
+        }
+
+        void _Wake() {
+            uint64_t one = 1;
+            while (write(m_Wake, &one, sizeof(one)) == -1 && errno == EINTR) {}
+        }
+
+        // Writer only, lets producers blocked in _PushWaiting retry
+        void _NotifySpace() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_SpaceWaiters.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> lock(m_SpaceMutex);
+                m_SpaceFreed.notify_all();
+            }
+        }
+
+        bool _OpenSegment(unsigned segment) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/install.%u.log.gz", segment);
+            m_File = gzopen((m_Dir + name).c_str(), "wb1"); // Fast level, the writer must keep up with pacstrap
+            if (!m_File) {
+                return false;
+            }
+            gzbuffer(m_File, 128 * 1024);
+            m_Segment = segment;
+            m_SegmentOffset = 0;
+            if (segment >= MaxSegments) {
+                std::snprintf(name, sizeof(name), "/install.%u.log.gz", segment - MaxSegments);
+                std::remove((m_Dir + name).c_str());
+            }
+            return true;
+        }
+
+        void _Append(const char* data, size_t size) {
+            gzwrite(m_File, data, static_cast<unsigned>(size));
+            m_SegmentOffset += static_cast<long>(size);
+        }
+
+        void _Consume(const _Slot& slot) {
+            char header[64];
+            switch (slot.kind) {
+            case _Kind::Begin: {
+                // Offsets are into the uncompressed segment, as zcat shows it
+                int length = std::snprintf(header, sizeof(header), "\n==== [%u] ", slot.command);
+                std::fprintf(m_Index, "%u\tbegin\t%u\t%ld\t%.*s\n", slot.command, m_Segment, m_SegmentOffset,
+                    static_cast<int>(slot.size), slot.data);
+                _Append(header, length);
+                _Append(slot.data, slot.size);
+                _Append("\n", 1);
+                m_Current = slot.command;
+                break;
+            }
+            case _Kind::Data:
+                if (slot.command != m_Current) {
+                    // Commands running side by side interleave, mark every switch
+                    int length = std::snprintf(header, sizeof(header), "\n---- [%u]\n", slot.command);
+                    _Append(header, length);
+                    m_Current = slot.command;
+                }
+                _Append(slot.data, slot.size);
+                break;
+            case _Kind::End: {
+                int length = std::snprintf(header, sizeof(header), "\n==== [%u] %.*s\n", slot.command,
+                    static_cast<int>(slot.size), slot.data);
+                _Append(header, length);
+                std::fprintf(m_Index, "%u\tend\t%u\t%ld\t%.*s\n", slot.command, m_Segment, m_SegmentOffset,
+                    static_cast<int>(slot.size), slot.data);
+                std::fflush(m_Index);
+                break;
+            }
+            }
+            // Segments rotate between records so no record spans two files
+            if (gzoffset(m_File) >= SegmentBytes) {
+                gzclose(m_File);
+                if (!_OpenSegment(m_Segment + 1)) {
+                    m_File = gzopen("/dev/null", "wb1");
+                }
+                m_Current = 0;
+            }
+        }
+
+        void _WriterLoop() {
+            while (true) {
+                bool stopping = m_Stopping.load(std::memory_order_acquire);
+                size_t drained = 0;
+                while (_IsReadable()) {
+                    _Slot& slot = m_Slots[m_Tail % Capacity];
+                    _Consume(slot);
+                    slot.sequence.store(m_Tail + Capacity, std::memory_order_release);
+                    ++m_Tail;
+                    if (++drained % 64 == 0) {
+                        _NotifySpace();
+                    }
+                }
+                if (drained % 64 != 0) {
+                    _NotifySpace();
+                }
+                if (stopping) {
+                    break;
+                }
+                if (drained == 0) {
+                    // Sleep until a producer publishes into the empty ring or Stop
+                    m_Idle.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (!_IsReadable() && !m_Stopping.load(std::memory_order_acquire)) {
+                        uint64_t count;
+                        read(m_Wake, &count, sizeof(count));
+                    }
+                    m_Idle.store(false, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    private:
+        std::unique_ptr<_Slot[]> m_Slots;
+        alignas(64) std::atomic<size_t> m_Head{ 0 };
+        alignas(64) size_t m_Tail = 0; // Writer thread only
+        std::atomic<uint32_t> m_Next{ 1 };
+        std::atomic<size_t> m_Dropped{ 0 };
+        std::atomic<bool> m_Enabled{ false };
+        std::atomic<bool> m_Stopping{ false };
+        std::atomic<bool> m_Idle{ false };  // Writer is about to sleep on m_Wake
+        int m_Wake = -1;                    // eventfd
+        std::atomic<size_t> m_SpaceWaiters{ 0 };
+        std::mutex m_SpaceMutex;
+        std::condition_variable m_SpaceFreed;
+        std::thread m_Writer;
+        // Writer thread state
+        std::string m_Dir;
+        FILE* m_Index = nullptr;
+        gzFile m_File = nullptr;
+        unsigned m_Segment = 0;
+        long m_SegmentOffset = 0;
+        uint32_t m_Current = 0;
+    };
+} // namespace InstallLog
+
+#endif /*INSTALLLOG_H_*/
@@ -6,27 +6,54 @@
 #include "Renderer.h"
 #include "Menu.h"
 #include "CLI.h"
+#include "ThreadPool.h"
+#include "ZoneInfo.h"
+#include "BlockDevices.h"
+#include "MirrorRanker.h"
+#include "Scheduler.h"
+#include "Trace.h"
+#include "ScriptRunner.h"
+#include "Answers.h"
+#include "PacmanProgress.h"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <atomic>
 
 class Installer {
 public:
     Installer() = default;
-    ~Installer() = default;
+    ~Installer() {
+        if (m_PrefetchCount > 0) {
+            m_Renderer.StopRenderer();
+            auto ms = [](std::chrono::steady_clock::duration d) {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
+                };
+            std::cout << "Prefetched " << m_PrefetchCount << " queries in "
+                << ms(m_PrefetchRuntime) << "ms, menus waited " << ms(m_PrefetchWaited)
+                << "ms (" << ms(m_PrefetchRuntime - m_PrefetchWaited) << "ms saved)" << std::endl;
+        }
+    }
     bool Init() {
         // Setup Input
         m_Input.Init();
-        m_Input.SetCallback([](char* c) {
-            std::unique_ptr<KeyEvent> event = std::make_unique<KeyEvent>(c);
-            EVENT_PUSH(std::move(event));
+        m_Input.SetCallback([this](const KeyEvent& event) {
+            if (event.GetKey() == Key::Resize) {
+                m_Resized.store(true, std::memory_order_relaxed);
+            }
+            EVENT_PUSH(event);
             return true;
             });
 
         // Setup Renderer
         try {
             m_Renderer.Init();
-            int maxy = getmaxy(stdscr);
-            int maxx = getmaxx(stdscr);
-            m_MainLayer = m_Renderer.CreateLayer(maxy, maxx, 0, 0);
-            m_SubLayer = m_Renderer.CreateSubLayer(m_MainLayer, maxy - 2, maxy - 2, 1, 1);
+            // Both follow the terminal size, the sub layer sits inside the main one's border
+            m_MainLayer = m_Renderer.CreateLayer(Layout());
+            Layout inner;
+            inner.top = inner.bottom = inner.left = inner.right = 1;
+            m_SubLayer = m_Renderer.CreateSubLayer(m_MainLayer, inner);
             m_MainWindow = m_Renderer.GetWindowPtr(m_MainLayer);
             m_SubWindow = m_Renderer.GetWindowPtr(m_SubLayer);
         }
@@ -37,6 +64,10 @@ public:
 
         m_DebuggerPresent = _IsDebuggerPresent();
 
+        // Query the menu contents up front, in parallel
+        m_Keymaps = _Prefetch(_ListKeymaps);
+        m_Timezones = _Prefetch(_ListTimezones);
+
         return true;
     }
 
@@ -44,7 +75,49 @@ public:
         m_Debug = true;
     }
 
+    // Takes every menu and prompt answer from the file, see Answers.h
+    // Might throw std::runtime_error if the file can't be read
+    void Unattended(const std::string& path) {
+        m_Answers = Answers(path);
+        m_Unattended = true;
+    }
+
+    // Starts the work that doesn't need the operator, overlapping the menus and
+    // cfdisk. Each task runs once its inputs are ready and the steps join it.
+    void ScheduleBackgroundTasks(const std::vector<std::string>& steps) {
+        if (m_Debug || std::find(steps.begin(), steps.end(), "2") == steps.end()) {
+            return; // Dry runs stop on every command, nothing to overlap
+        }
+        // Best effort like the reflector run it replaces, a failure must not fail
+        // the tasks after it, the existing mirrorlist is kept then
+        m_Scheduler.Add("mirrors", {}, [this]() {
+            try {
+                std::string ranked = _RankMirrors();
+                if (!ranked.empty()) {
+                    CLI::WriteToFile(m_Mirrorlist, ranked);
+                }
+            }
+            catch (const std::exception& e) {
+                m_MirrorsError = e.what();
+            }
+            });
+        // Optional, pacstrap still downloads whatever is missing
+        m_Scheduler.Add("keyring", { "mirrors" }, []() {
+            _RunQuiet("pacman", "-Sy --noconfirm archlinux-keyring", false);
+            });
+        m_Scheduler.Add("package-cache", { "keyring" }, [this]() {
+            _RunQuiet("pacman", "-Sw --noconfirm " + m_BasePackages, false);
+            });
+        m_Scheduler.Add("pacstrap", { "package-cache", "mnt" }, [this]() {
+            _RunQuiet("pacstrap", "-c /mnt " + m_BasePackages, true, [this](std::string_view line) {
+                std::lock_guard<std::mutex> lock(m_PacstrapMutex);
+                m_PacstrapProgress.Feed(line);
+                });
+            });
+    }
+
     void Step1() {
+        Trace::Scope span("step", "Step1");
         try {
             _KBLayout();
             _SystemClock();
@@ -52,24 +125,32 @@ public:
         }
         catch (std::exception& e) {
             std::cerr << e.what() << std::endl;
-            _DebugStop();
+            if (!m_Unattended) { // Nobody is there to press enter
+                _DebugStop();
+            }
             throw e;
         }
     }
 
     void Step2() {
+        Trace::Scope span("step", "Step2");
         try {
+            // Partitions are mounted by now, whether Step1 ran or not
+            m_Scheduler.Provide("mnt");
             _SelectMirrors();
             _InstallPackages();
         }
         catch (std::exception& e) {
             std::cerr << e.what() << std::endl;
-            _DebugStop();
+            if (!m_Unattended) { // Nobody is there to press enter
+                _DebugStop();
+            }
             throw e;
         }
     }
 
     void Step3() {
+        Trace::Scope span("step", "Step3");
         try {
             _Chroot();
             _TimeZone();
@@ -81,11 +162,37 @@ public:
         }
         catch (std::exception& e) {
             std::cerr << e.what() << std::endl;
-            _DebugStop();
+            if (!m_Unattended) { // Nobody is there to press enter
+                _DebugStop();
+            }
             throw e;
         }
     }
 
+    // Runs a step of the Commands script instead of the built in one
+    void RunScriptStep(int stepNumber) {
+        Trace::Scope span("step", "Commands step", std::to_string(stepNumber));
+        try {
+            CommandScript::StepView step = CLI::ParseCommands(stepNumber);
+            if (step.empty()) {
+                throw std::runtime_error("No commands for step " + std::to_string(stepNumber));
+            }
+            // Dry runs stop after every command, so groups run one at a time
+            Script::Runner runner(
+                [this](std::string_view name) { return _ScriptVariable(name); },
+                [this](const std::string& command, const std::string& args) { return _RunCommand(command, args); },
+                !m_Debug);
+            runner.Run(step);
+        }
+        catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            if (!m_Unattended) { // Nobody is there to press enter
+                _DebugStop();
+            }
+            throw;
+        }
+    }
+
 
 private:
     bool _IsDebuggerPresent() {
@@ -99,19 +206,164 @@ private:
         return false;
     }
 
-    void _RunCommand(const std::string& command, const std::string& args) {
+    // Runs a background task's command with all output captured. Its stdin is
+    // /dev/null, the terminal belongs to the menus and cfdisk running meanwhile.
+    static void _RunQuiet(const std::string& command, const std::string& args, bool required,
+        const CLI::LineCallback& onLine = nullptr) {
+        Trace::Scope span("background", command, args);
+        Process::Result result;
+        std::string output = CLI::RunCommand(command.c_str(), args.c_str(), onLine, &result, true, CLI::NullInput());
+        span.SetResult(result);
+        if (!result.Success() && required) {
+            size_t tail = output.size() > 2048 ? output.size() - 2048 : 0;
+            throw std::runtime_error(command + " " + args + " failed:\n" + output.substr(tail));
+        }
+    }
+
+    // input, if not empty, is fed to the command's stdin through a pipe
+    Process::Result _RunCommand(const std::string& command, const std::string& args, const std::string& input = std::string()) {
+        Trace::Scope span("command", command, args);
+        Process::Result result;
         if (m_Debug) {
             m_Renderer.StopRenderer();
             std::cout << "\033[2J\033[1;1H" << std::flush; // Clean the screen
-            std::cout << "Dry Run: " << command << " " << args << std::endl;
+            std::cout << "Dry Run: " << command << " " << args;
+            if (!input.empty()) {
+                std::cout << " < " << input.size() << " bytes of input"; // Might hold passwords
+            }
+            std::cout << std::endl;
             _DebugStop();
+            result.exitCode = 0;
+        }
+        else if (input.empty()) {
+            CLI::RunCommand(command.c_str(), args.c_str(), nullptr, &result);
+            span.SetResult(result);
+        }
+        else {
+            // Passwords, kept off the disk of the live system
+            int inputFd = CLI::InputPipe(input);
+            try {
+                CLI::RunCommand(command.c_str(), args.c_str(), nullptr, &result, false, inputFd);
+            }
+            catch (...) {
+                close(inputFd);
+                throw;
+            }
+            close(inputFd);
+            span.SetResult(result);
+        }
+        return result;
+    }
+
+    // Time between two frames of the progress layer
+    static constexpr std::chrono::milliseconds _ProgressFrame{ 66 };
+
+    // Shows progress in a centered layer until done(timeout) returns true. The work
+    // runs on another thread and feeds progress under mutex, ncurses stays on this one.
+    // A frame is drawn every interval, lines or not, so the rate and ETA keep moving.
+    void _ShowProgress(PacmanProgress& progress, std::mutex& mutex,
+        const std::function<bool(std::chrono::milliseconds)>& done) {
+        Layout popup;
+        popup.left = popup.right = 2;
+        popup.height = 6;
+        popup.width = 76;
+        popup.center = true;
+        WinHandle layer = m_Renderer.CreateLayer(popup);
+        WINDOW* window = m_Renderer.GetWindowPtr(layer);
+
+        try {
+            do {
+                if (m_Resized.exchange(false, std::memory_order_relaxed)) {
+                    m_Renderer.OnResize(); // Nothing reads the key queue meanwhile
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    progress.Draw(window);
+                }
+                m_Renderer.MarkDirty(layer);
+                m_Renderer.OnUpdate();
+            } while (!done(_ProgressFrame));
+        }
+        catch (...) {
+            m_Renderer.DestroyLayer(layer);
+            throw;
+        }
+        m_Renderer.DestroyLayer(layer);
+        m_Renderer.OnUpdate();
+    }
+
+    // Runs pacman or pacstrap with its output parsed into a progress layer instead of
+    // the raw text, stderr included so errors can't scroll over the screen. A prompt
+    // wouldn't be shown either, so stdin is /dev/null and it can't wait for keys.
+    Process::Result _RunWithProgress(const std::string& command, const std::string& args) {
+        if (m_Debug) {
+            return _RunCommand(command, args);
+        }
+        Trace::Scope span("command", command, args);
+        PacmanProgress progress;
+        std::mutex mutex;
+        Process::Result result;
+        std::future<void> run = std::async(std::launch::async, [&]() {
+            CLI::RunCommand(command.c_str(), args.c_str(), [&](std::string_view line) {
+                std::lock_guard<std::mutex> lock(mutex);
+                progress.Feed(line);
+                }, &result, true, CLI::NullInput());
+            });
+        _ShowProgress(progress, mutex, [&](std::chrono::milliseconds timeout) {
+            if (run.wait_for(timeout) != std::future_status::ready) {
+                return false;
+            }
+            run.get(); // Rethrows what RunCommand threw
+            return true;
+            });
+        span.SetResult(result);
+        return result;
+    }
+
+    // Unattended runs stop at the first failure instead of leaving it to the operator
+    void _RunChecked(const std::string& command, const std::string& args, const std::string& input = std::string()) {
+        Process::Result result = _RunCommand(command, args, input);
+        if (!result.Success()) {
+            throw std::runtime_error("Command failed: " + command + " " + args);
+        }
+    }
+
+    // Checked when unattended, otherwise a failure stays on screen for the operator
+    void _RunStep(const std::string& command, const std::string& args) {
+        if (m_Unattended) {
+            _RunChecked(command, args);
         }
         else {
-            CLI::RunCommand(command.c_str(), args.c_str());
+            _RunCommand(command, args);
         }
     }
 
+    // Interactive edit of a generated file, skipped when unattended
+    void _EditFile(const std::string& file) {
+        if (!m_Unattended) {
+            _RunInteractiveCommand("nano", file);
+        }
+    }
+
+    // Values for ${name} in the Commands script, asked for on first use
+    std::string _ScriptVariable(std::string_view name) {
+        if (name == "keymap") {
+            if (m_Keymap.empty()) {
+                _SelectKeymap();
+            }
+            return m_Keymap;
+        }
+        if (name == "timezone") {
+            if (m_Timezone.empty()) {
+                _SetTimeZone();
+            }
+            return m_Timezone;
+        }
+        throw std::runtime_error("Unknown variable in Commands: ${" + std::string(name) + "}");
+    }
+
     void _RunInteractiveCommand(const std::string& command, const std::string& args) {
+        Trace::Scope span("interactive", command, args);
         if (m_Debug) {
             m_Renderer.StopRenderer();
             std::cout << "\033[2J\033[1;1H" << std::flush; // Clean the screen
@@ -120,12 +372,16 @@ private:
         }
         else {
             m_Input.PauseInputHandler();
-            CLI::RunInteractiveCommand(command.c_str(), args.c_str());
+            Process::Result result;
+            CLI::RunInteractiveCommand(command.c_str(), args.c_str(), &result);
+            span.SetResult(result);
             m_Input.ResumeInputHandler();
+            m_Renderer.OnResize(); // The command had SIGWINCH to itself
         }
     }
 
     void _WriteToFile(const std::string& file, const std::string& content) {
+        Trace::Scope span("file", file);
         if (m_Debug) {
             m_Renderer.StopRenderer();
             std::cout << "\033[2J\033[1;1H" << std::flush; // Clean the screen
@@ -147,34 +403,97 @@ private:
         }
     }
 
+    struct _Prefetched {
+        std::string output;
+        std::chrono::steady_clock::duration runtime;
+    };
+
+    static std::string _ListKeymaps() {
+        return CLI::RunCommand("localectl", "list-keymaps");
+    }
+
+    static std::string _ListTimezones() {
+        return ZoneInfo::ListTimezones();
+    }
+
+    std::future<_Prefetched> _Prefetch(std::string(*query)()) {
+        return m_Pool.Submit([query]() {
+            Trace::Scope span("prefetch", "prefetch");
+            auto start = std::chrono::steady_clock::now();
+            std::string output = query();
+            return _Prefetched{ std::move(output), std::chrono::steady_clock::now() - start };
+            });
+    }
+
+    // Takes the prefetched output, or runs the query if it was already used
+    std::string _Collect(std::future<_Prefetched>& prefetched, std::string(*query)()) {
+        if (!prefetched.valid()) {
+            return query();
+        }
+        auto start = std::chrono::steady_clock::now();
+        _Prefetched result = prefetched.get();
+        m_PrefetchWaited += std::chrono::steady_clock::now() - start;
+        m_PrefetchRuntime += result.runtime;
+        ++m_PrefetchCount;
+        return std::move(result.output);
+    }
+
+    void _RunMenu(Menu& menu) {
+        // Sleeps until keys arrive, then applies all that are queued and
+        // redraws once if the menu changed. Keys after the selecting one stay
+        // queued for whatever reads input next.
+        Trace::Scope span("menu", "menu wait");
+        m_Renderer.OnUpdate();
+        KeyEvent events[64];
+        while (!menu.IsSelected()) {
+            EventQueue& queue = EventQueue::Get();
+            queue.WaitAvailable();
+            size_t count = queue.Peek(events, 64);
+            // Keys up to a resize go to the menu, the resize itself lays out again
+            size_t keys = 0;
+            while (keys < count && events[keys].GetKey() != Key::Resize) {
+                ++keys;
+            }
+            bool redraw = false;
+            size_t used = menu.OnEvents(events, keys, redraw);
+            if (used == keys && keys < count) {
+                m_Renderer.OnResize();
+                menu.Relayout();
+                redraw = true;
+                ++used;
+            }
+            queue.Discard(used);
+            if (redraw) {
+                m_Renderer.OnUpdate();
+            }
+        }
+    }
+
     void _KBLayout() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
+        // Might throw std::bad_alloc cause of Menu::Init() from _SelectKeymap()
+        _SelectKeymap();
+        _RunStep("loadkeys", m_Keymap);
+    }
+
+    void _SelectKeymap() {
+        // Might throw std::runtime_error cause of CLI::RunCommand()
         // Might throw std::bad_alloc cause of Menu::Init()
-        std::string command;
-        std::string args;
+        if (m_Unattended) {
+            m_Keymap = m_Answers.Get("keymap");
+            m_Scheduler.Provide("keymap");
+            return;
+        }
         std::string output;
-        output = CLI::RunCommand("localectl", "list-keymaps");
+        output = _Collect(m_Keymaps, _ListKeymaps);
         if (output.empty()) {
             throw std::runtime_error("Failed to get keyboard layouts");
         }
         Menu menu = Menu(m_MainWindow, m_SubWindow);
-        menu.Init(output);
-
-        while (true) {
-            std::unique_ptr<KeyEvent> event = EVENT_POP();
-            if (event != nullptr) {
-                menu.OnEvent(*event.get());
-            }
-            m_Renderer.OnUpdate();
-            if (menu.IsSelected()) {
-                break;
-            }
-        }
-
-        command = "loadkeys";
-        args = menu.GetSelected();
-        m_Keymap = args;
-        _RunCommand(command, args);
+        menu.Init(std::move(output));
+        _RunMenu(menu);
+        m_Keymap = menu.GetSelected();
+        m_Scheduler.Provide("keymap");
     }
 
     void _SystemClock() {
@@ -188,59 +507,72 @@ private:
             _SetTimeZone();
         }
         args = "set-timezone " + m_Timezone;
-        _RunCommand(command, args);
+        _RunStep(command, args);
     }
 
     void _SetTimeZone() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
         // Might throw std::bad_alloc cause of Menu::Init()
+        if (m_Unattended) {
+            m_Timezone = m_Answers.Get("timezone");
+            m_Scheduler.Provide("timezone");
+            return;
+        }
         std::string output;
-        output = CLI::RunCommand("timedatectl", "list-timezones");
+        output = _Collect(m_Timezones, _ListTimezones);
         if (output.empty()) {
             throw std::runtime_error("Failed to get timezones");
         }
         Menu menu = Menu(m_MainWindow, m_SubWindow);
-        menu.Init(output);
+        menu.Init(std::move(output));
+        _RunMenu(menu);
+        m_Timezone = menu.GetSelected();
+        m_Scheduler.Provide("timezone");
+    }
 
-        while (true) {
-            std::unique_ptr<KeyEvent> event = EVENT_POP();
-            if (event != nullptr) {
-                menu.OnEvent(*event.get());
-            }
-            m_Renderer.OnUpdate();
-            if (menu.IsSelected()) {
-                break;
-            }
+    static std::string _FormatDevice(const BlockDevices::BlockDevice& device, bool partition) {
+        std::string kind = partition ? "part" : (device.removable ? "removable" : (device.rotational ? "hdd" : "ssd"));
+        char row[256];
+        std::snprintf(row, sizeof(row), "%s%-*s %8s  %-9s %s",
+            partition ? "  " : "", partition ? 14 : 16, device.name.c_str(),
+            BlockDevices::FormatSize(device.size).c_str(), kind.c_str(), device.model.c_str());
+        std::string line = row;
+        for (const auto& holder : device.holders) {
+            line += " -> " + holder;
         }
-        m_Timezone = menu.GetSelected();
+        return line + "\n";
     }
 
     void _PartitionDisks() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
         // Might throw std::bad_alloc cause of Menu::Init()
+        if (m_Unattended) {
+            _PartitionFromAnswers();
+            return;
+        }
         std::string command;
         std::string args;
-        std::string output;
-        output = CLI::RunCommand("lsblk");
-        if (output.empty()) {
+        std::vector<BlockDevices::BlockDevice> disks = BlockDevices::Scan();
+        if (disks.empty()) {
             throw std::runtime_error("Failed to get disks");
         }
-        Menu menu = Menu(m_MainWindow, m_SubWindow);
-        menu.Init(output);
-
-        while (true) {
-            std::unique_ptr<KeyEvent> event = EVENT_POP();
-            if (event != nullptr) {
-                menu.OnEvent(*event.get());
-            }
-            m_Renderer.OnUpdate();
-            if (menu.IsSelected()) {
-                break;
+        // One row per disk and partition, a partition selects its disk
+        std::string rows;
+        std::vector<size_t> rowDisk;
+        for (size_t i = 0; i < disks.size(); ++i) {
+            rows += _FormatDevice(disks[i], false);
+            rowDisk.push_back(i);
+            for (const auto& partition : disks[i].partitions) {
+                rows += _FormatDevice(partition, true);
+                rowDisk.push_back(i);
             }
         }
+        Menu menu = Menu(m_MainWindow, m_SubWindow);
+        menu.Init(std::move(rows));
+        _RunMenu(menu);
         command = "cfdisk";
 
-        args = "/dev/" + CLI::ExtractDiskOrPartitionName(menu.GetSelected());
+        args = "/dev/" + disks[rowDisk[menu.GetSelectedIndex()]].name;
         _RunInteractiveCommand(command, args);
         std::cout << "\033[2J\033[1;1H"; // Clean the screen
         std::cout << "Your currently in a shell inside the installer, you can run any command you want." << std::endl;
@@ -251,16 +583,86 @@ private:
         _RunInteractiveCommand("bash", "");
     }
 
+    // disk = sda, then one sfdisk line per "partition = ..." (e.g. size=1G, type=uefi),
+    // "format = 1 mkfs.fat -F32" and "mount = 1 /boot" name partitions by number,
+    // mounts run in file order below /mnt
+    void _PartitionFromAnswers() {
+        // Might throw std::runtime_error if an answer is missing or a command fails
+        std::string disk = m_Answers.Get("disk");
+        if (disk.rfind("/dev/", 0) != 0) {
+            disk = "/dev/" + disk;
+        }
+        const std::vector<std::string>& partitions = m_Answers.GetAll("partition");
+        if (partitions.empty()) {
+            throw std::runtime_error("Answers file has no 'partition'");
+        }
+        std::string layout = "label: " + (m_Answers.Has("label") ? m_Answers.Get("label") : std::string("gpt")) + "\n";
+        for (const auto& partition : partitions) {
+            layout += partition + "\n";
+        }
+        _RunChecked("sfdisk", "--wipe always " + disk, layout);
+
+        // nvme0n1 -> nvme0n1p2, sda -> sda2
+        auto device = [&disk](const std::string& number) {
+            return disk + (std::isdigit(static_cast<unsigned char>(disk.back())) ? "p" : "") + number;
+            };
+        // Splits "<number> <rest>" lines
+        auto split = [](const std::string& line, const char* key) {
+            size_t space = line.find_first_of(" \t");
+            size_t rest = space == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", space);
+            if (rest == std::string::npos) {
+                throw std::runtime_error(std::string("Bad '") + key + "' answer: " + line);
+            }
+            return std::make_pair(line.substr(0, space), line.substr(rest));
+            };
+        for (const auto& format : m_Answers.GetAll("format")) {
+            auto [number, mkfs] = split(format, "format");
+            size_t space = mkfs.find_first_of(" \t");
+            std::string command = mkfs.substr(0, space);
+            std::string args = space == std::string::npos ? "" : mkfs.substr(space + 1) + " ";
+            _RunChecked(command, args + device(number));
+        }
+        for (const auto& mount : m_Answers.GetAll("mount")) {
+            auto [number, target] = split(mount, "mount");
+            _RunChecked("mount", "--mkdir " + device(number) + " /mnt" + target);
+        }
+    }
+
+    // Empty if no mirror answered, the existing mirrorlist is kept then
+    std::string _RankMirrors() {
+        std::vector<Mirrors::Mirror> mirrors = Mirrors::ParseMirrorlist(m_Mirrorlist);
+        Mirrors::Probe(mirrors);
+        std::vector<Mirrors::Mirror> ranked = Mirrors::Rank(std::move(mirrors), 5);
+        if (ranked.empty()) {
+            return "";
+        }
+        return Mirrors::FormatMirrorlist(ranked);
+    }
+
     void _SelectMirrors() {
-        // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
-        _RunCommand("reflector", "--verbose --latest 5 --sort rate --save /etc/pacman.d/mirrorlist");
+        // Might throw std::runtime_error cause of _WriteToFile()
+        if (m_Scheduler.Has("mirrors")) {
+            m_Scheduler.Wait("mirrors");
+            if (!m_MirrorsError.empty()) {
+                std::cerr << "Keeping the existing mirrorlist, ranking failed: " << m_MirrorsError << std::endl;
+            }
+            return;
+        }
+        std::string ranked = _RankMirrors();
+        if (!ranked.empty()) {
+            _WriteToFile(m_Mirrorlist, ranked);
+        }
     }
 
     void _InstallPackages() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
         // Might throw std::bad_alloc cause of Menu::Init()
-        _RunCommand("pacstrap", "/mnt base linux linux-firmware linux-lts");
-        _RunCommand("arch-chroot", "/mnt");
+        // The scheduled pacstrap keeps running while the packages are picked
+        bool background = m_Scheduler.Has("pacstrap");
+        if (!background) {
+            _RunWithProgress("pacstrap", "/mnt " + m_BasePackages);
+            _RunCommand("arch-chroot", "/mnt");
+        }
         std::ostringstream oss;
         oss << "NetworkManager\n" << "less\n" << "curl\n" << "base-devel\n";
         oss << "usbutils\n" << "reflector\n" << "wget\n" << "htop\n";
@@ -272,40 +674,49 @@ private:
         oss << "xdg-utils\n" << "ddcutil\n" << "yakuake\n" << "gnome-calculator\n";
         oss << "gnome-text-editor\n" << "nautilus-share\n";
         oss << "nautilus\n" << "gvfs-smb\n";
-        Menu menu = Menu(m_MainWindow, m_SubWindow);
-        menu.Init(oss.str());
-        menu.TogglableItems(true);
-        mvwprintw(m_MainWindow, 0, 0, "Use space to remove the packages you don't want enter to continue");
-
-        while (true) {
-            std::unique_ptr<KeyEvent> event = EVENT_POP();
-            if (event != nullptr) {
-                menu.OnEvent(*event.get());
-            }
-            m_Renderer.OnUpdate();
-            if (menu.IsSelected()) {
-                break;
+        std::string args = oss.str();
+        if (m_Unattended) {
+            // Without an answer the whole list is installed
+            if (m_Answers.Has("packages")) {
+                args = m_Answers.Get("packages");
             }
         }
-
-        std::string selected = menu.GetSelected();
-        std::string args = oss.str();
-        // Split the 'selected' string into individual items
-        std::istringstream iss(selected);
-        std::vector<std::string> itemsToRemove;
-        std::string item;
-        while (iss >> item) {
-            itemsToRemove.push_back(item);
+        else {
+            Menu menu = Menu(m_MainWindow, m_SubWindow);
+            menu.Init(oss.str());
+            menu.TogglableItems(true);
+            mvwprintw(m_MainWindow, 0, 0, "Use space to remove the packages you don't want enter to continue");
+            _RunMenu(menu);
+
+            // Toggled items are the ones to leave out, one pass over the flags
+            const std::vector<bool>& removed = menu.GetToggled();
+            args.clear();
+            for (size_t i = 0; i < removed.size(); ++i) {
+                if (!removed[i]) {
+                    args.append(menu.GetItem(i)).append(" ");
+                }
+            }
         }
-        // Remove the packages that are selected
-        for (auto& item : itemsToRemove) {
-            args.erase(args.find(item), item.length() + 1);
+        if (background) {
+            // Whatever is left of pacstrap shows its progress, failures are rethrown here
+            _ShowProgress(m_PacstrapProgress, m_PacstrapMutex, [this](std::chrono::milliseconds timeout) {
+                return m_Scheduler.WaitFor("pacstrap", timeout);
+                });
+            _RunCommand("arch-chroot", "/mnt");
         }
+
         // replace all newlines with spaces
         std::replace(args.begin(), args.end(), '\n', ' ');
         std::string command = "pacman";
-        args = "-S " + args;
-        _RunInteractiveCommand(command, args);
+        if (m_Unattended) {
+            if (!_RunWithProgress(command, "-S --noconfirm " + args).Success()) {
+                throw std::runtime_error("Command failed: " + command + " -S --noconfirm " + args);
+            }
+        }
+        else {
+            args = "-S " + args;
+            _RunInteractiveCommand(command, args);
+        }
         _RunCommand("exit", "");
     }
 
@@ -322,25 +733,33 @@ private:
             _SetTimeZone();
         }
         std::string args = "-sf /usr/share/zoneinfo/" + m_Timezone + " /etc/localtime";
-        _RunCommand(command, args);
-        _RunCommand("hwclock", "--systohc");
+        _RunStep(command, args);
+        _RunStep("hwclock", "--systohc");
     }
 
     void _Localization() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
         std::string args;
         std::string command;
-        m_Input.PauseInputHandler();
-        std::cout << "/etc/locale.gen will be opened in nano, ";
-        std::cout << "uncomment the locales you want to use and save the file." << std::endl;
-        std::cout << "\rPress enter to continue." << std::endl;
-        getchar();
-        _RunInteractiveCommand("nano", "/etc/locale.gen");
-        _RunCommand("locale-gen", "");
-        m_Input.PauseInputHandler();
-        std::cout << "Enter your locale (e.g. en_US.UTF-8): ";
-        std::cin >> args;
-        std::cout << "\n\r" << std::flush;
+        if (m_Unattended) {
+            // Uncomment the locale's line, e.g. "#en_US.UTF-8 UTF-8"
+            args = m_Answers.Get("locale");
+            _RunChecked("sed", "-i \"s/^#" + args + " /" + args + " /\" /etc/locale.gen");
+            _RunChecked("locale-gen", "");
+        }
+        else {
+            m_Input.PauseInputHandler();
+            std::cout << "/etc/locale.gen will be opened in nano, ";
+            std::cout << "uncomment the locales you want to use and save the file." << std::endl;
+            std::cout << "\rPress enter to continue." << std::endl;
+            getchar();
+            _RunInteractiveCommand("nano", "/etc/locale.gen");
+            _RunCommand("locale-gen", "");
+            m_Input.PauseInputHandler();
+            std::cout << "Enter your locale (e.g. en_US.UTF-8): ";
+            std::cin >> args;
+            std::cout << "\n\r" << std::flush;
+        }
         command = "/etc/locale.conf";
         args = "LANG=" + args;
         _WriteToFile(command, args);
@@ -354,18 +773,23 @@ private:
 
     void _NetworkConfiguration() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
-        m_Input.PauseInputHandler();
         std::string command;
         std::string args;
-        std::cout << "Enter your hostname: ";
-        std::cin >> args;
+        if (m_Unattended) {
+            args = m_Answers.Get("hostname");
+        }
+        else {
+            m_Input.PauseInputHandler();
+            std::cout << "Enter your hostname: ";
+            std::cin >> args;
+        }
         command = "/etc/hostname";
         _WriteToFile(command, args);
     }
 
     void _Initramfs() {
         // Might throw std::runtime_error cause of CLI::RunCommand() or CLI::RunInteractiveCommand()
-        _RunCommand("mkinitcpio", "-P");
+        _RunStep("mkinitcpio", "-P");
     }
 
     void _Accounts() {
@@ -373,6 +797,14 @@ private:
         std::string command;
         std::string args;
         std::string username;
+        if (m_Unattended) {
+            // Both passwords go through chpasswd's stdin, never the command line
+            username = m_Answers.Get("username");
+            _RunChecked("useradd", "-m -G wheel " + username);
+            _RunChecked("chpasswd", "", "root:" + m_Answers.Get("root_password") + "\n"
+                + username + ":" + m_Answers.Get("user_password") + "\n");
+            return;
+        }
         std::cout << "An interactive shell will with passwd command run for you to set the root password." << std::endl;
         std::cout << "Press enter to continue." << std::endl;
         getchar();
@@ -382,7 +814,7 @@ private:
         std::cout << "Enter your username: ";
         std::cin >> username;
         command = "useradd";
-        args = "-m -G wheel " + args;
+        args = "-m -G wheel " + username;
         _RunCommand(command, args);
         std::cout << "\nAn interactive shell will with passwd command run for you to set the user password." << std::endl;
         std::cout << "Press enter to continue." << std::endl;
@@ -395,14 +827,19 @@ private:
         std::string command;
         std::string args;
         std::string dir;
-        _RunCommand("bootctl", "install");
-        m_Input.PauseInputHandler();
-        std::cout << "Configuring the boot loader." << std::endl;
-        std::cout << "Each entry will be done automatically, than you will be dropped";
-        std::cout << "into nano to edit to your liking." << std::endl;
-        std::cout << "Default entry will be set to arch.conf." << std::endl;
-        std::cout << "Enter the path where the boot partition is mounted (e.g. /boot): ";
-        std::cin >> dir;
+        _RunStep("bootctl", "install");
+        if (m_Unattended) {
+            dir = m_Answers.Get("boot_dir");
+        }
+        else {
+            m_Input.PauseInputHandler();
+            std::cout << "Configuring the boot loader." << std::endl;
+            std::cout << "Each entry will be done automatically, than you will be dropped";
+            std::cout << "into nano to edit to your liking." << std::endl;
+            std::cout << "Default entry will be set to arch.conf." << std::endl;
+            std::cout << "Enter the path where the boot partition is mounted (e.g. /boot): ";
+            std::cin >> dir;
+        }
         command = dir + "/loader/loader.conf";
         std::ostringstream oss;
         oss << "default arch.conf\n";
@@ -411,7 +848,7 @@ private:
         oss << "editor no\n";
         args = oss.str();
         _WriteToFile(command, args);
-        _RunInteractiveCommand("nano", command);
+        _EditFile(command);
 
         command = dir + "/loader/entries/arch.conf";
         oss.str("");
@@ -421,7 +858,7 @@ private:
         oss << "options root=\"LABEL=Arch OS\" rw quiet\n";
         args = oss.str();
         _WriteToFile(command, args);
-        _RunInteractiveCommand("nano", command);
+        _EditFile(command);
 
         command = dir + "/loader/entries/arch-lts.conf";
         oss.str("");
@@ -431,7 +868,7 @@ private:
         oss << "options root=\"LABEL=Arch OS\" rw quiet\n";
         args = oss.str();
         _WriteToFile(command, args);
-        _RunInteractiveCommand("nano", command);
+        _EditFile(command);
 
         command = dir + "/loader/entries/arch-fallback.conf";
         oss.str("");
@@ -441,7 +878,7 @@ private:
         oss << "options root=\"LABEL=Arch OS\" rw quiet\n";
         args = oss.str();
         _WriteToFile(command, args);
-        _RunInteractiveCommand("nano", command);
+        _EditFile(command);
 
         command = dir + "/loader/entries/arch-lts-fallback.conf";
         oss.str("");
@@ -451,7 +888,7 @@ private:
         oss << "options root=\"LABEL=Arch OS\" rw quiet\n";
         args = oss.str();
         _WriteToFile(command, args);
-        _RunInteractiveCommand("nano", command);
+        _EditFile(command);
     }
 
 private:
@@ -461,10 +898,30 @@ private:
     WINDOW* m_MainWindow;
     WINDOW* m_SubWindow;
     InputHandler m_Input;
+    std::atomic<bool> m_Resized{ false }; // Set by the input thread on SIGWINCH
     std::string m_Keymap;
     std::string m_Timezone;
     bool m_DebuggerPresent = false;
     bool m_Debug = false;
+    bool m_Unattended = false;
+    Answers m_Answers;
+    const std::string m_Mirrorlist = "/etc/pacman.d/mirrorlist";
+    const std::string m_BasePackages = "base linux linux-firmware linux-lts";
+    // One thread per prefetched menu query (keymaps, timezones), plus one for
+    // the scheduled tasks, a dependency chain that never runs two at once
+    static constexpr size_t PrefetchQueries = 2;
+    static constexpr size_t ScheduledChains = 1;
+    ThreadPool m_Pool{ PrefetchQueries + ScheduledChains };
+    std::future<_Prefetched> m_Keymaps;
+    std::future<_Prefetched> m_Timezones;
+    std::chrono::steady_clock::duration m_PrefetchRuntime{};
+    std::chrono::steady_clock::duration m_PrefetchWaited{};
+    int m_PrefetchCount = 0;
+    // Work that runs alongside the menus, see ScheduleBackgroundTasks
+    std::string m_MirrorsError; // Set by the mirrors task, read after waiting for it
+    std::mutex m_PacstrapMutex;
+    PacmanProgress m_PacstrapProgress; // Fed by the scheduled pacstrap
+    Scheduler m_Scheduler{ m_Pool };
 };
 
 #endif /*INSTALLER_H_*/
@@ -0,0 +1,226 @@
+#ifndef KEYDECODER_H_
+#define KEYDECODER_H_
+
+#include <string>
+#include <cstddef>
+#include <algorithm>
+
+#include "KeyEvent.h"
+
+// Splits raw terminal input into keys, any number of them per read
+// A sequence cut by the end of a read waits in the decoder for the rest, a lone
+// ESC waits until Flush since it may be the start of one
+class KeyDecoder {
+public:
+    // Calls emit(const KeyEvent&) for every complete key in data, in order
+    template<typename Emit>
+    void Feed(const char* data, size_t size, Emit&& emit) {
+        m_Pending.append(data, size);
+        _Drain(false, emit);
+    }
+
+    // Decodes whatever is pending as it stands, for when no more bytes came in time
+    template<typename Emit>
+    void Flush(Emit&& emit) {
+        _Drain(true, emit);
+    }
+
+    inline bool HasPending() const { return !m_Pending.empty(); }
+
+private:
+    struct _Final {
+        char byte;
+        Key key;
+        uint8_t modifiers;
+    };
+
+    // Final byte of "ESC [ params X" and "ESC O X". "ESC O M" is keypad Enter, but
+    // "ESC [ M" starts an X10 mouse report, so M isn't in here.
+    static constexpr _Final _Finals[] = {
+        { 'A', Key::Up, 0 }, { 'B', Key::Down, 0 }, { 'C', Key::Right, 0 }, { 'D', Key::Left, 0 },
+        { 'H', Key::Home, 0 }, { 'F', Key::End, 0 }, { 'P', Key::F1, 0 }, { 'Q', Key::F2, 0 },
+        { 'R', Key::F3, 0 }, { 'S', Key::F4, 0 }, { 'Z', Key::Tab, ModShift },
+    };
+
+    // First parameter of "ESC [ n ~" (vt220 style), Key::None where unassigned
+    static constexpr Key _Tilde[] = {
+        Key::None, Key::Home, Key::Insert, Key::Delete, Key::End, Key::PageUp, Key::PageDown, Key::Home,
+        Key::End, Key::None, Key::None, Key::F1, Key::F2, Key::F3, Key::F4, Key::F5,
+        Key::None, Key::F6, Key::F7, Key::F8, Key::F9, Key::F10, Key::None, Key::F11,
+        Key::F12,
+    };
+
+    // Longest escape sequence taken apart, anything longer is dropped as garbage
+    static constexpr size_t _MaxSequence = 32;
+
+    template<typename Emit>
+    void _Drain(bool final, Emit& emit) {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(m_Pending.data());
+        size_t size = m_Pending.size();
+        size_t pos = 0;
+        while (pos < size) {
+            KeyEvent event;
+            size_t used = _Decode(data + pos, size - pos, event, final);
+            if (used == 0) {
+                break; // Incomplete, the next read finishes it
+            }
+            if (event.GetKey() != Key::None) {
+                emit(event);
+            }
+            pos += used;
+        }
+        m_Pending.erase(0, pos);
+    }
+
+    static uint8_t _Modifiers(unsigned value) {
+        return value > 1 ? static_cast<uint8_t>((value - 1) & (ModShift | ModAlt | ModCtrl)) : 0;
+    }
+
+    static KeyEvent _FinalKey(char byte, uint8_t modifiers) {
+        for (const _Final& entry : _Finals) {
+            if (entry.byte == byte) {
+                return KeyEvent(entry.key, 0, entry.modifiers | modifiers);
+            }
+        }
+        return KeyEvent();
+    }
+
+    // "ESC [ params final", returns the bytes used or 0 if the final byte is missing
+    static size_t _DecodeCsi(const unsigned char* data, size_t size, KeyEvent& event) {
+        // Linux console F1-F5 are "ESC [ [ A" to "ESC [ [ E"
+        if (size >= 3 && data[2] == '[') {
+            if (size < 4) {
+                return 0;
+            }
+            if (data[3] >= 'A' && data[3] <= 'E') {
+                event = KeyEvent(static_cast<Key>(static_cast<int>(Key::F1) + (data[3] - 'A')));
+            }
+            return 4;
+        }
+        unsigned params[2] = { 0, 0 };
+        size_t param = 0;
+        size_t pos = 2;
+        for (; pos < size && data[pos] >= 0x30 && data[pos] <= 0x3f; ++pos) {
+            if (data[pos] == ';') {
+                param = std::min<size_t>(param + 1, 2);
+            }
+            else if (param < 2 && data[pos] >= '0' && data[pos] <= '9') {
+                params[param] = params[param] * 10 + (data[pos] - '0');
+            }
+            if (pos >= _MaxSequence) {
+                return pos + 1;
+            }
+        }
+        if (pos == size) {
+            return 0;
+        }
+        char final = static_cast<char>(data[pos]);
+        if (final == 'M' && pos == 2) {
+            // X10 mouse report, button and position follow as three raw bytes
+            return size < 6 ? 0 : 6;
+        }
+        if (final == '~') {
+            if (params[0] < sizeof(_Tilde) / sizeof(_Tilde[0])) {
+                event = KeyEvent(_Tilde[params[0]], 0, _Modifiers(params[1]));
+            }
+        }
+        else {
+            event = _FinalKey(final, _Modifiers(params[1]));
+        }
+        return pos + 1;
+    }
+
+    // Returns the bytes used for event, 0 if data only holds the start of a key
+    static size_t _Decode(const unsigned char* data, size_t size, KeyEvent& event, bool final) {
+        unsigned char byte = data[0];
+        if (byte == 0x1b) {
+            if (size == 1) {
+                if (!final) {
+                    return 0;
+                }
+                event = KeyEvent(Key::Escape);
+                return 1;
+            }
+            if (data[1] == '[') {
+                size_t used = _DecodeCsi(data, size, event);
+                if (used == 0 && final) {
+                    event = KeyEvent(Key::Char, '[', ModAlt); // Alt+[ typed alone
+                    return 2;
+                }
+                return used;
+            }
+            if (data[1] == 'O') {
+                if (size < 3) {
+                    if (!final) {
+                        return 0;
+                    }
+                    event = KeyEvent(Key::Char, 'O', ModAlt);
+                    return 2;
+                }
+                event = data[2] == 'M' ? KeyEvent(Key::Enter) : _FinalKey(static_cast<char>(data[2]), 0);
+                return 3;
+            }
+            // ESC before any other key is how terminals send Alt
+            size_t used = _Decode(data + 1, size - 1, event, final);
+            if (used == 0) {
+                return 0;
+            }
+            event = KeyEvent(event.GetKey(), event.GetCodepoint(), event.GetModifiers() | ModAlt);
+            return used + 1;
+        }
+        if (byte == '\r' || byte == '\n') {
+            event = KeyEvent(Key::Enter);
+            return 1;
+        }
+        if (byte == '\t') {
+            event = KeyEvent(Key::Tab);
+            return 1;
+        }
+        if (byte == 0x7f || byte == '\b') {
+            event = KeyEvent(Key::Backspace);
+            return 1;
+        }
+        if (byte == 0) {
+            event = KeyEvent(Key::Char, ' ', ModCtrl);
+            return 1;
+        }
+        if (byte < 0x20) {
+            // Ctrl+A is 0x01, Ctrl+\ to Ctrl+_ follow Ctrl+Z
+            event = KeyEvent(Key::Char, byte < 0x1b ? U'a' + (byte - 1) : U'\\' + (byte - 0x1c), ModCtrl);
+            return 1;
+        }
+        if (byte < 0x80) {
+            event = KeyEvent(Key::Char, byte);
+            return 1;
+        }
+
+        // UTF-8, a malformed byte becomes U+FFFD on its own
+        size_t length = byte >= 0xf0 && byte <= 0xf4 ? 4 : byte >= 0xe0 ? 3 : byte >= 0xc2 && byte < 0xe0 ? 2 : 0;
+        if (length == 0 || byte > 0xf4) {
+            event = KeyEvent(Key::Char, 0xfffd);
+            return 1;
+        }
+        char32_t codepoint = byte & (0x7f >> length);
+        for (size_t i = 1; i < length; ++i) {
+            if (i == size) {
+                if (!final) {
+                    return 0;
+                }
+                event = KeyEvent(Key::Char, 0xfffd);
+                return i;
+            }
+            if ((data[i] & 0xc0) != 0x80) {
+                event = KeyEvent(Key::Char, 0xfffd);
+                return i;
+            }
+            codepoint = (codepoint << 6) | (data[i] & 0x3f);
+        }
+        event = KeyEvent(Key::Char, codepoint);
+        return length;
+    }
+
+private:
+    std::string m_Pending;
+};
+
+#endif /*KEYDECODER_H_*/
@@ -1,64 +1,149 @@
 #ifndef _KEYEVENT_H_
 #define _KEYEVENT_H_
 
-#include <functional>
-#include <queue>
-#include <memory>
+#include <atomic>
+#include <algorithm>
 #include <cstring>
-#include <mutex>
+#include <cstdint>
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Normalized key codes, see KeyDecoder.h for the byte sequences behind them
+enum class Key : uint8_t {
+    None, Char, Enter, Tab, Backspace, Escape,
+    Up, Down, Left, Right, Home, End, PageUp, PageDown, Insert, Delete,
+    F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12,
+    Resize // Not a key, the terminal changed size (SIGWINCH)
+};
+
+// Bit flags, combined as xterm encodes them (modifier parameter - 1)
+enum KeyModifier : uint8_t {
+    ModShift = 1,
+    ModAlt = 2,
+    ModCtrl = 4
+};
 
 class KeyEvent {
 public:
-    KeyEvent(char* key) {
-        std::memcpy(m_Key, key, 10);
-    }
-    inline const char* GetKey() const { return m_Key; }
+    KeyEvent() = default;
+    KeyEvent(Key key, char32_t codepoint = 0, uint8_t modifiers = 0) :
+        m_Codepoint(codepoint), m_Key(key), m_Modifiers(modifiers) {}
+    inline Key GetKey() const { return m_Key; }
+    // Unicode codepoint of a Key::Char, Ctrl+A comes as 'a' with ModCtrl
+    inline char32_t GetCodepoint() const { return m_Codepoint; }
+    inline uint8_t GetModifiers() const { return m_Modifiers; }
+    inline bool Is(Key key, uint8_t modifiers = 0) const { return m_Key == key && m_Modifiers == modifiers; }
+    // A plain character without Ctrl or Alt, what filtering and typing take
+    inline bool IsText() const { return m_Key == Key::Char && (m_Modifiers & (ModAlt | ModCtrl)) == 0; }
 private:
-    char m_Key[10];
+    char32_t m_Codepoint = 0;
+    Key m_Key = Key::None;
+    uint8_t m_Modifiers = 0;
 };
 
+// Bounded single producer (input thread) single consumer (UI loop) ring
+// Events are stored inline, a full ring drops the newest key
 class EventQueue {
 public:
-    EventQueue() = default;
-    ~EventQueue() = default;
+    static constexpr size_t Capacity = 1024; // Must be a power of two, holds a pasted line
+
+    EventQueue() {
+        m_EventFd = eventfd(0, EFD_CLOEXEC);
+        if (m_EventFd == -1) {
+            throw std::system_error(errno, std::system_category(), "Failed to create eventfd");
+        }
+    }
+    ~EventQueue() {
+        close(m_EventFd);
+    }
 
     static inline EventQueue& Get() {
         static EventQueue instance;
         return instance;
     }
 
-    void Push(std::unique_ptr<KeyEvent> event) {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-        m_EventQueue.push(std::move(event));
+    // Producer only
+    bool Push(const KeyEvent& event) {
+        size_t head = m_Head.load(std::memory_order_relaxed);
+        if (head - m_Tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_Events[head & (Capacity - 1)] = event;
+        m_Head.store(head + 1, std::memory_order_release);
+
+        // Wake the consumer, the eventfd counter can't lose a wakeup
+        uint64_t one = 1;
+        while (write(m_EventFd, &one, sizeof(one)) == -1 && errno == EINTR) {}
+        return true;
     }
 
-    std::unique_ptr<KeyEvent> Pop() {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-        if (m_EventQueue.empty()) return nullptr;
-        std::unique_ptr<KeyEvent> event = std::move(m_EventQueue.front());
-        m_EventQueue.pop();
-        return event;
+    // Consumer only
+    bool Pop(KeyEvent& event) {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail == m_Head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        event = m_Events[tail & (Capacity - 1)];
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, blocks until an event is available
+    void WaitPop(KeyEvent& event) {
+        while (!Pop(event)) {
+            uint64_t count;
+            read(m_EventFd, &count, sizeof(count));
+        }
+    }
+
+    // Consumer only, blocks until at least one event is available
+    void WaitAvailable() {
+        while (IsEmpty()) {
+            uint64_t count;
+            read(m_EventFd, &count, sizeof(count));
+        }
+    }
+
+    // Consumer only, copies up to max queued events without taking them,
+    // Discard then takes as many as were used
+    size_t Peek(KeyEvent* events, size_t max) const {
+        size_t tail = m_Tail.load(std::memory_order_relaxed);
+        size_t count = std::min(max, m_Head.load(std::memory_order_acquire) - tail);
+        for (size_t i = 0; i < count; ++i) {
+            events[i] = m_Events[(tail + i) & (Capacity - 1)];
+        }
+        return count;
+    }
+
+    // Consumer only
+    void Discard(size_t count) {
+        m_Tail.store(m_Tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
     }
 
     bool IsEmpty() const {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-        return m_EventQueue.empty();
+        return m_Tail.load(std::memory_order_acquire) == m_Head.load(std::memory_order_acquire);
     }
 
+    // Consumer only
     void Clear() {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-        while (!m_EventQueue.empty()) {
-            m_EventQueue.pop();
-        }
+        m_Tail.store(m_Head.load(std::memory_order_acquire), std::memory_order_release);
     }
 
+    // Becomes readable whenever events were pushed, for use with poll
+    inline int GetFd() const { return m_EventFd; }
+
 private:
-    mutable std::mutex m_Mutex;
-    std::queue<std::unique_ptr<KeyEvent>> m_EventQueue;
+    alignas(64) std::atomic<size_t> m_Head = 0;
+    alignas(64) std::atomic<size_t> m_Tail = 0;
+    KeyEvent m_Events[Capacity];
+    int m_EventFd = -1;
 };
 
 #define EVENT_PUSH(event) EventQueue::Get().Push(event)
-#define EVENT_POP() EventQueue::Get().Pop()
+#define EVENT_POP(event) EventQueue::Get().Pop(event)
+#define EVENT_WAIT(event) EventQueue::Get().WaitPop(event)
 #define QUEUE_CLEAR() EventQueue::Get().Clear()
 
 #endif /*_KEYEVENT_H_*/
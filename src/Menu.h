@@ -1,3 +1,6 @@
+#ifndef MENU_H_
+#define MENU_H_
+
 #include <ncurses.h>
 #include <menu.h>
 #include <vector>
@@ -8,6 +11,10 @@
 #include <system_error>
 #include <cerrno>
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <cctype>
 
 #include "KeyEvent.h"
 
@@ -19,43 +26,45 @@ public:
     }
     ~Menu() = default;
 
-    bool Init(const std::string& items) {
+    // Items are newline separated, only the rows visible in the sub window
+    // get ncurses items, which are rebuilt as the menu scrolls
+    bool Init(std::string items) {
         try
         {
-            // Parse the items string and create menu items
-            std::istringstream stream(items);
-            std::string line;
-            while (std::getline(stream, line)) {
-                m_MenuItemStrings.emplace_back(std::make_unique<char[]>(line.size() + 1));
-                std::strcpy(m_MenuItemStrings.back().get(), line.c_str());
-                ITEM* rawItem = new_item(m_MenuItemStrings.back().get(), nullptr);
-                if (!rawItem)
-                    throw std::bad_alloc();
-                set_item_userptr(rawItem, (void*)m_MenuItemStrings.back().get());
-                m_MenuItems.emplace_back(rawItem, _ItemDeleter());
+            // Keep the items in one buffer, each one NUL terminated in place
+            m_Store = std::move(items);
+            if (m_Store.size() > UINT32_MAX) {
+                throw std::length_error("Menu items too large");
+            }
+            size_t start = 0;
+            while (start < m_Store.size()) {
+                size_t end = m_Store.find('\n', start);
+                if (end == std::string::npos) {
+                    end = m_Store.size();
+                }
+                else {
+                    m_Store[end] = '\0';
+                }
+                if (end > start) { // ncurses rejects empty names
+                    m_Offsets.push_back(static_cast<uint32_t>(start));
+                }
+                start = end + 1;
             }
+            m_Toggled.assign(m_Offsets.size(), false);
+            m_Cursor = 0;
+            m_Top = 0;
 
-            // Create array of menu items for MENU
-            ITEM** rawItems;
-            rawItems = (ITEM**)calloc(m_MenuItems.size() + 1, sizeof(ITEM*));
-            if (!rawItems)
-                throw std::bad_alloc();
+            // Search index is folded on the first filter key
+            m_Folded.clear();
+            m_View.resize(m_Offsets.size());
+            for (size_t i = 0; i < m_View.size(); ++i) {
+                m_View[i] = static_cast<uint32_t>(i);
+            }
 
             // Create MENU
-            m_MenuItemsArray.reset(rawItems);
-            for (int i = 0; i < m_MenuItems.size(); ++i) {
-                rawItems[i] = m_MenuItems[i].get();
-            }
-            rawItems[m_MenuItems.size()] = nullptr;
-            MENU* rawMenu = new_menu(rawItems);
-            if (!rawMenu)
+            _Bind();
+            if (!m_Menu.get())
                 throw std::bad_alloc();
-            m_Menu.reset(rawMenu);
-            set_menu_win(rawMenu, m_MenuWin);
-            set_menu_sub(rawMenu, m_MenuSubWin);
-            set_menu_format(rawMenu, getmaxy(m_MenuSubWin), 1);
-            _SetMenuOpts();
-            post_menu(rawMenu);
         }
         catch (const std::exception& e)
         {
@@ -75,55 +84,93 @@ public:
         return false;
     }
 
-    void OnEvent(KeyEvent& event) {
-        post_menu(m_Menu.get());
-        if (m_selected) {
-            return;
-        }
-        char key[10];
-        std::memcpy(key, event.GetKey(), 10);
-        if (key[0] == '\033' && key[1] == '[' && key[2] == 'A') { // Up arrow
-            menu_driver(m_Menu.get(), REQ_UP_ITEM);
-        }
-        else if (key[0] == '\033' && key[1] == '[' && key[2] == 'B') { // Down arrow
-            menu_driver(m_Menu.get(), REQ_DOWN_ITEM);
+    // Returns true if the menu changed and needs to be redrawn
+    bool OnEvent(const KeyEvent& event) {
+        if (m_selected || !m_Menu.get()) {
+            return false;
         }
-        else if (key[0] == '\033' && key[1] == '[' && key[2] == '5') { // Page up
-            menu_driver(m_Menu.get(), REQ_SCR_UPAGE);
+        long page = static_cast<long>(_PageRows());
+        switch (event.GetKey()) {
+        case Key::Up:
+            return _MoveTo(static_cast<long>(m_Cursor) - 1);
+        case Key::Down:
+            return _MoveTo(static_cast<long>(m_Cursor) + 1);
+        case Key::PageUp:
+            return _Scroll(-page);
+        case Key::PageDown:
+            return _Scroll(page);
+        case Key::Home:
+            return _MoveTo(0);
+        case Key::End:
+            return _MoveTo(static_cast<long>(m_View.size()) - 1);
+        case Key::Escape:
+            return _ClearFilter();
+        case Key::Enter:
+            m_selected = !m_View.empty();
+            return false;
+        case Key::Backspace:
+            return _PopFilter();
+        default:
+            break;
         }
-        else if (key[0] == '\033' && key[1] == '[' && key[2] == '6') { // Page down
-            menu_driver(m_Menu.get(), REQ_SCR_DPAGE);
+        if (!event.IsText()) {
+            return false;
         }
-        else if (m_MenuOpts.m_Togglable && key[0] == ' ') // Space
-        {
-            menu_driver(m_Menu.get(), REQ_TOGGLE_ITEM);
+        if (m_MenuOpts.m_Togglable && event.GetCodepoint() == U' ') { // Space
+            if (m_View.empty()) {
+                return false;
+            }
+            uint32_t item = m_View[m_Cursor];
+            m_Toggled[item] = !m_Toggled[item];
+            set_item_value(current_item(m_Menu.get()), m_Toggled[item]);
+            return true;
         }
-        else if (key[0] == '\n' || key[0] == '\r') { // Enter
-            m_selected = true;
+        return _PushFilter(event.GetCodepoint()); // Type to filter
+    }
+
+    // Applies a batch of keys in order, runs of Up/Down/Home/End are folded into a
+    // single cursor move so a held arrow key costs one rebind per batch
+    // Stops after the key that selects, returns how many keys were used
+    size_t OnEvents(const KeyEvent* events, size_t count, bool& redraw) {
+        redraw = false;
+        size_t used = 0;
+        while (used < count && !m_selected) {
+            long cursor = static_cast<long>(m_Cursor);
+            size_t run = used;
+            while (run < count && _Movement(events[run], cursor)) {
+                ++run;
+            }
+            if (run > used) {
+                redraw = _MoveTo(cursor) || redraw;
+                used = run;
+            }
+            else {
+                redraw = OnEvent(events[used++]) || redraw;
+            }
         }
+        return used;
     }
 
+    // Name of the current item, togglable menus report through GetToggled
     std::string GetSelected() {
-        if (!m_Menu.get()) {
+        if (!m_Menu.get() || m_View.empty()) {
             return "";
         }
+        return _Name(m_View[m_Cursor]);
+    }
 
-        if (!m_MenuOpts.m_Togglable) {
-            ITEM* cur = current_item(m_Menu.get());
-            return item_name(cur);
-        }
-        else {
-            std::ostringstream selected;
-            ITEM** items = menu_items(m_Menu.get());
-            for (int i = 0; i < item_count(m_Menu.get()); ++i) {
-                if (item_value(items[i])) {
-                    selected << item_name(items[i]) << " ";
-                }
-            }
-            return selected.str();
-        }
+    // Position of the current item among the non-empty lines given to Init,
+    // -1 when the filter matches nothing
+    long GetSelectedIndex() const {
+        return m_View.empty() ? -1 : static_cast<long>(m_View[m_Cursor]);
     }
 
+    // Toggle state of every item, indexed like GetSelectedIndex, filtering
+    // doesn't affect it
+    inline const std::vector<bool>& GetToggled() const { return m_Toggled; }
+    inline size_t GetItemCount() const { return m_Offsets.size(); }
+    inline const char* GetItem(size_t index) const { return _Name(index); }
+
     MENU* GetMenu() {
         return m_Menu.get();
     }
@@ -137,6 +184,23 @@ public:
         m_MenuOpts.m_MenuMark = mark;
         _SetMenuOpts();
     }
+
+    // Call after the windows were resized, reposts with the new page size
+    // keeping the cursor row in view
+    void Relayout() {
+        if (!m_Menu.get()) {
+            return;
+        }
+        unpost_menu(m_Menu.get());
+        werase(m_MenuWin);
+        box(m_MenuWin, 0, 0);
+        size_t rows = _PageRows();
+        if (m_Cursor >= m_Top + rows) {
+            m_Top = m_Cursor - rows + 1;
+        }
+        m_Top = std::min(m_Top, m_View.size() > rows ? m_View.size() - rows : 0);
+        _Bind();
+    }
 private:
     // Custom deleter for Item smart pointers
     struct _ItemDeleter {
@@ -176,13 +240,245 @@ private:
             menu_opts_on(m_Menu.get(), O_ONEVALUE);
         }
         set_menu_mark(m_Menu.get(), m_MenuOpts.m_MenuMark.c_str());
+        _Bind();
+    }
+
+    inline const char* _Name(size_t index) const {
+        return m_Store.data() + m_Offsets[index];
+    }
+
+    inline size_t _PageRows() const {
+        int rows = getmaxy(m_MenuSubWin);
+        return rows > 0 ? static_cast<size_t>(rows) : 1;
+    }
+
+    // Rebuilds the ncurses items for the rows starting at m_Top and reposts
+    void _Bind() {
+        size_t count = std::min(_PageRows(), m_View.size() - m_Top);
+
+        std::vector<std::unique_ptr<ITEM, _ItemDeleter>> window;
+        window.reserve(count);
+        ITEM** rawItems = (ITEM**)calloc(count + 1, sizeof(ITEM*));
+        if (!rawItems)
+            throw std::bad_alloc();
+        std::unique_ptr<ITEM*, _ItemArrayDeleter> itemsArray(rawItems);
+        for (size_t i = 0; i < count; ++i) {
+            ITEM* rawItem = new_item(_Name(m_View[m_Top + i]), nullptr);
+            if (!rawItem)
+                throw std::bad_alloc();
+            window.emplace_back(rawItem, _ItemDeleter());
+            rawItems[i] = rawItem;
+        }
+
+        if (!m_Menu.get()) {
+            MENU* rawMenu = new_menu(rawItems);
+            if (!rawMenu)
+                throw std::bad_alloc();
+            m_Menu.reset(rawMenu);
+            set_menu_win(rawMenu, m_MenuWin);
+            set_menu_sub(rawMenu, m_MenuSubWin);
+            set_menu_mark(rawMenu, m_MenuOpts.m_MenuMark.c_str());
+        }
+        else {
+            unpost_menu(m_Menu.get());
+            set_menu_items(m_Menu.get(), count > 0 ? rawItems : nullptr);
+        }
+        // The previous items are disconnected now and can be freed
+        m_MenuItems = std::move(window);
+        m_MenuItemsArray = std::move(itemsArray);
+
+        set_menu_format(m_Menu.get(), static_cast<int>(_PageRows()), 1);
+        if (m_MenuOpts.m_Togglable) {
+            for (size_t i = 0; i < count; ++i) {
+                set_item_value(rawItems[i], m_Toggled[m_View[m_Top + i]]);
+            }
+        }
+        if (count > 0) {
+            set_current_item(m_Menu.get(), rawItems[m_Cursor - m_Top]);
+        }
+        werase(m_MenuSubWin);
         post_menu(m_Menu.get());
+        _DrawFilter();
+    }
+
+    // Where key would put the cursor, false if it isn't a plain cursor movement
+    bool _Movement(const KeyEvent& event, long& cursor) const {
+        if (m_View.empty() || !m_Menu.get()) {
+            return false;
+        }
+        long last = static_cast<long>(m_View.size()) - 1;
+        switch (event.GetKey()) {
+        case Key::Up:
+            cursor = std::max(cursor - 1, 0L);
+            return true;
+        case Key::Down:
+            cursor = std::min(cursor + 1, last);
+            return true;
+        case Key::Home:
+            cursor = 0;
+            return true;
+        case Key::End:
+            cursor = last;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Moves the cursor, scrolling the bound rows only when it leaves them
+    bool _MoveTo(long index) {
+        if (m_View.empty()) {
+            return false;
+        }
+        index = std::clamp(index, 0L, static_cast<long>(m_View.size()) - 1);
+        if (static_cast<size_t>(index) == m_Cursor) {
+            return false;
+        }
+        m_Cursor = static_cast<size_t>(index);
+
+        size_t rows = _PageRows();
+        size_t top = m_Top;
+        if (m_Cursor < top) {
+            top = m_Cursor;
+        }
+        else if (m_Cursor >= top + rows) {
+            top = m_Cursor - rows + 1;
+        }
+
+        if (top != m_Top) {
+            m_Top = top;
+            _Bind();
+        }
+        else {
+            set_current_item(m_Menu.get(), m_MenuItemsArray.get()[m_Cursor - m_Top]);
+        }
+        return true;
+    }
+
+    // Moves the window and the cursor together, like REQ_SCR_UPAGE/DPAGE
+    bool _Scroll(long delta) {
+        if (m_View.empty()) {
+            return false;
+        }
+        size_t rows = _PageRows();
+        long lastTop = m_View.size() > rows ? static_cast<long>(m_View.size() - rows) : 0;
+        size_t top = static_cast<size_t>(std::clamp(static_cast<long>(m_Top) + delta, 0L, lastTop));
+        if (top == m_Top) {
+            return _MoveTo(delta < 0 ? 0 : static_cast<long>(m_View.size()) - 1);
+        }
+        m_Cursor = static_cast<size_t>(std::clamp(static_cast<long>(m_Cursor) + delta,
+            static_cast<long>(top), static_cast<long>(std::min(top + rows, m_View.size())) - 1));
+        m_Top = top;
+        _Bind();
+        return true;
+    }
+
+    // Narrows the current results, a longer query only ever matches a subset
+    // Appends the character UTF-8 encoded, names are folded to lowercase ASCII only
+    bool _PushFilter(char32_t c) {
+        if (c < 0x80) {
+            m_Query.push_back(static_cast<char>(std::tolower(static_cast<int>(c))));
+        }
+        else if (c < 0x800) {
+            m_Query.push_back(static_cast<char>(0xc0 | (c >> 6)));
+            m_Query.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+        else if (c < 0x10000) {
+            m_Query.push_back(static_cast<char>(0xe0 | (c >> 12)));
+            m_Query.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            m_Query.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+        else {
+            m_Query.push_back(static_cast<char>(0xf0 | (c >> 18)));
+            m_Query.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+            m_Query.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+            m_Query.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+        }
+        if (m_Folded.empty()) { // Case folded copy sharing the offsets
+            m_Folded = m_Store;
+            for (char& c : m_Folded) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        std::vector<uint32_t> narrowed;
+        for (uint32_t item : m_View) {
+            if (std::strstr(m_Folded.data() + m_Offsets[item], m_Query.c_str())) {
+                narrowed.push_back(item);
+            }
+        }
+        uint32_t item = _CursorItem();
+        m_ViewStack.push_back(std::move(m_View));
+        m_View = std::move(narrowed);
+        _Refilter(item);
+        return true;
+    }
+
+    // Restores the results from before the last character
+    bool _PopFilter() {
+        if (m_ViewStack.empty()) {
+            return false;
+        }
+        uint32_t item = _CursorItem();
+        // One view per character, so a multibyte character goes as a whole
+        while (!m_Query.empty() && (static_cast<unsigned char>(m_Query.back()) & 0xc0) == 0x80) {
+            m_Query.pop_back();
+        }
+        m_Query.pop_back();
+        m_View = std::move(m_ViewStack.back());
+        m_ViewStack.pop_back();
+        _Refilter(item);
+        return true;
+    }
+
+    bool _ClearFilter() {
+        if (m_ViewStack.empty()) {
+            return false;
+        }
+        uint32_t item = _CursorItem();
+        m_Query.clear();
+        m_View = std::move(m_ViewStack.front());
+        m_ViewStack.clear();
+        _Refilter(item);
+        return true;
+    }
+
+    // Keeps the cursor on the same item if it is still visible
+    void _Refilter(uint32_t item) {
+        auto it = std::lower_bound(m_View.begin(), m_View.end(), item);
+        m_Cursor = (it != m_View.end() && *it == item) ? it - m_View.begin() : 0;
+        m_Top = m_Cursor >= _PageRows() ? m_Cursor - _PageRows() + 1 : 0;
+        _Bind();
+    }
+
+    inline uint32_t _CursorItem() const {
+        return m_View.empty() ? UINT32_MAX : m_View[m_Cursor];
+    }
+
+    void _DrawFilter() {
+        int maxy = getmaxy(m_MenuWin);
+        int maxx = getmaxx(m_MenuWin);
+        mvwhline(m_MenuWin, maxy - 1, 1, ACS_HLINE, maxx - 2);
+        if (!m_Query.empty()) {
+            mvwprintw(m_MenuWin, maxy - 1, 2, " Filter: %.*s (%zu) ",
+                std::max(0, maxx - 24), m_Query.c_str(), m_View.size());
+        }
     }
 
 private:
     WINDOW* m_MenuWin = nullptr;
     WINDOW* m_MenuSubWin = nullptr;
-    std::vector<std::unique_ptr<char[]>> m_MenuItemStrings;
+    std::string m_Store;
+    std::vector<uint32_t> m_Offsets;
+    std::vector<bool> m_Toggled;
+    // Type to filter state, m_View holds the matching items in order
+    std::string m_Folded;
+    std::string m_Query;
+    std::vector<uint32_t> m_View;
+    std::vector<std::vector<uint32_t>> m_ViewStack;
+    // Cursor and top row are positions in m_View
+    size_t m_Cursor = 0;
+    size_t m_Top = 0;
+    // Only the visible rows are materialized
     std::vector<std::unique_ptr<ITEM, _ItemDeleter>> m_MenuItems;
     std::unique_ptr<ITEM*, _ItemArrayDeleter> m_MenuItemsArray = nullptr;
     std::unique_ptr<MENU, _MenuDeleter> m_Menu = nullptr;
@@ -193,3 +489,5 @@ private:
     } m_MenuOpts;
 
 };
+
+#endif /*MENU_H_*/
@@ -0,0 +1,470 @@
+#ifndef MIRRORRANKER_H_
+#define MIRRORRANKER_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// Ranks pacman mirrors by downloading a small file from all of them at once
+// https mirrors can't be downloaded from without a TLS library, for them only the
+// TCP connect time to port 443 is measured
+namespace Mirrors
+{
+    struct Mirror {
+        std::string server; // As written in the mirrorlist, with $repo and $arch
+        std::string host;
+        std::string port;
+        std::string path;   // Test file path on the host
+        bool tls = false;   // https, only connected to
+        double latencyMs = -1.0;    // Request start to first response byte, or to connected
+        double bytesPerSecond = 0.0; // 0 when nothing was downloaded
+        bool ok = false;
+        std::string error;
+    };
+
+    struct ProbeOptions {
+        std::string repo = "core";
+        std::string arch = "x86_64";
+        std::chrono::milliseconds timeout{ 5000 }; // Per mirror, and for all host lookups
+        size_t maxBytes = 1 << 20; // Stop reading once this much body arrived
+        size_t concurrency = 32;
+    };
+
+    std::string _Replace(std::string text, const std::string& from, const std::string& to) {
+        for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos + to.size())) {
+            text.replace(pos, from.size(), to);
+        }
+        return text;
+    }
+
+    // Splits scheme://host[:port]/path, the host may be a bracketed IPv6 address
+    bool _ParseServer(Mirror& mirror, const ProbeOptions& options) {
+        std::string url = _Replace(_Replace(mirror.server, "$repo", options.repo), "$arch", options.arch);
+        size_t schemeEnd = url.find("://");
+        if (schemeEnd == std::string::npos) {
+            return false;
+        }
+        std::string scheme = url.substr(0, schemeEnd);
+        if (scheme != "http" && scheme != "https") {
+            return false;
+        }
+        mirror.tls = scheme == "https";
+        size_t hostStart = schemeEnd + 3;
+        size_t pathStart = url.find('/', hostStart);
+        std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+        std::string path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+        // "[::1]:8080", "[::1]", "host:8080" or "host"
+        size_t colon;
+        if (!authority.empty() && authority.front() == '[') {
+            size_t close = authority.find(']');
+            if (close == std::string::npos) {
+                return false;
+            }
+            mirror.host = authority.substr(1, close - 1);
+            colon = authority[close + 1] == ':' ? close + 1 : std::string::npos;
+        }
+        else {
+            colon = authority.find(':');
+            mirror.host = authority.substr(0, colon);
+        }
+        mirror.port = colon != std::string::npos ? authority.substr(colon + 1) : (mirror.tls ? "443" : "80");
+        if (path.back() != '/') {
+            path += '/';
+        }
+        mirror.path = path + options.repo + ".db";
+        return !mirror.host.empty();
+    }
+
+    // Active Server lines, in file order without duplicates
+    std::vector<Mirror> ParseMirrorlist(const std::string& filePath) {
+        std::vector<Mirror> mirrors;
+        std::ifstream file(filePath);
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 6, "Server") != 0) {
+                continue;
+            }
+            size_t equals = line.find('=', start);
+            if (equals == std::string::npos) {
+                continue;
+            }
+            std::istringstream iss(line.substr(equals + 1));
+            Mirror mirror;
+            iss >> mirror.server;
+            if (mirror.server.empty()) {
+                continue;
+            }
+            bool seen = std::any_of(mirrors.begin(), mirrors.end(),
+                [&](const Mirror& other) { return other.server == mirror.server; });
+            if (!seen) {
+                mirrors.push_back(std::move(mirror));
+            }
+        }
+        return mirrors;
+    }
+
+    struct _Probe {
+        enum class State { Connecting, Sending, Receiving };
+        Mirror* mirror = nullptr;
+        int fd = -1;
+        State state = State::Connecting;
+        std::string request;
+        size_t sent = 0;
+        std::string header;
+        bool headerDone = false;
+        bool download = true; // False once only the connect or the status line is measured
+        long long contentLength = -1;
+        size_t body = 0;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point firstByte;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void _Finish(_Probe& probe, const std::string& error) {
+        auto now = std::chrono::steady_clock::now();
+        Mirror& mirror = *probe.mirror;
+        if (error.empty() && (probe.body > 0 || !probe.download)) {
+            double seconds = std::chrono::duration<double>(now - probe.start).count();
+            mirror.ok = true;
+            mirror.latencyMs = std::chrono::duration<double, std::milli>(probe.firstByte - probe.start).count();
+            mirror.bytesPerSecond = probe.download && seconds > 0.0 ? probe.body / seconds : 0.0;
+        }
+        else {
+            mirror.ok = false;
+            mirror.error = error.empty() ? "Empty response" : error;
+        }
+        close(probe.fd);
+        probe.fd = -1;
+    }
+
+    // Returns false once the probe is finished
+    bool _OnReadable(_Probe& probe, char* buffer, size_t size, size_t maxBytes) {
+        while (true) {
+            ssize_t count = recv(probe.fd, buffer, size, 0);
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                _Finish(probe, std::strerror(errno));
+                return false;
+            }
+            if (count == 0) {
+                _Finish(probe, probe.headerDone ? "" : "Connection closed");
+                return false;
+            }
+            if (probe.header.empty() && !probe.headerDone) {
+                probe.firstByte = std::chrono::steady_clock::now();
+            }
+
+            size_t bodyBytes = count;
+            if (!probe.headerDone) {
+                probe.header.append(buffer, count);
+                size_t end = probe.header.find("\r\n\r\n");
+                if (end == std::string::npos) {
+                    if (probe.header.size() > 16384) {
+                        _Finish(probe, "Header too large");
+                        return false;
+                    }
+                    continue;
+                }
+                // "HTTP/1.1 200 OK", a redirect (usually to https) still shows the mirror is up
+                size_t space = probe.header.find(' ');
+                if (space != std::string::npos && probe.header.compare(space + 1, 1, "3") == 0) {
+                    probe.download = false;
+                    _Finish(probe, "");
+                    return false;
+                }
+                if (space == std::string::npos || probe.header.compare(space + 1, 3, "200") != 0) {
+                    _Finish(probe, "HTTP " + probe.header.substr(space == std::string::npos ? 0 : space + 1, 3));
+                    return false;
+                }
+                std::string lower = probe.header.substr(0, end);
+                std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+                size_t length = lower.find("\r\ncontent-length:");
+                if (length != std::string::npos) {
+                    probe.contentLength = std::strtoll(lower.c_str() + length + 17, nullptr, 10);
+                }
+                probe.headerDone = true;
+                bodyBytes = probe.header.size() - (end + 4);
+            }
+
+            probe.body += bodyBytes;
+            if (probe.body >= maxBytes ||
+                (probe.contentLength >= 0 && probe.body >= static_cast<size_t>(probe.contentLength))) {
+                _Finish(probe, "");
+                return false;
+            }
+        }
+    }
+
+    // Returns false once the probe is finished
+    bool _OnWritable(_Probe& probe, int epollFd) {
+        if (probe.state == _Probe::State::Connecting) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(probe.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0) {
+                _Finish(probe, std::strerror(error));
+                return false;
+            }
+            if (probe.mirror->tls) {
+                probe.firstByte = std::chrono::steady_clock::now();
+                probe.download = false;
+                _Finish(probe, "");
+                return false;
+            }
+            probe.state = _Probe::State::Sending;
+        }
+        while (probe.sent < probe.request.size()) {
+            ssize_t count = send(probe.fd, probe.request.data() + probe.sent, probe.request.size() - probe.sent, MSG_NOSIGNAL);
+            if (count < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                _Finish(probe, std::strerror(errno));
+                return false;
+            }
+            probe.sent += count;
+        }
+        probe.state = _Probe::State::Receiving;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &probe;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, probe.fd, &event);
+        return true;
+    }
+
+    bool _Start(_Probe& probe, const addrinfo* address, int epollFd, const ProbeOptions& options) {
+        probe.start = std::chrono::steady_clock::now();
+        probe.deadline = probe.start + options.timeout;
+        probe.request = "GET " + probe.mirror->path + " HTTP/1.1\r\nHost: " + probe.mirror->host +
+            "\r\nUser-Agent: Arch-Installer\r\nAccept: */*\r\nConnection: close\r\n\r\n";
+
+        probe.fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (probe.fd == -1) {
+            probe.mirror->error = std::strerror(errno);
+            return false;
+        }
+        if (connect(probe.fd, address->ai_addr, address->ai_addrlen) == -1 && errno != EINPROGRESS) {
+            _Finish(probe, std::strerror(errno));
+            return false;
+        }
+        epoll_event event{};
+        event.events = EPOLLOUT;
+        event.data.ptr = &probe;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, probe.fd, &event);
+        return true;
+    }
+
+    // getaddrinfo can't be cancelled, so the lookups run on detached threads that
+    // share this with the caller, who stops waiting at the deadline. A lookup that
+    // finishes after that frees its own result.
+    struct _Lookups {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::vector<std::pair<std::string, std::string>> hosts; // Host and port, empty host to skip
+        std::vector<addrinfo*> results;
+        size_t next = 0;
+        size_t pending = 0;
+        bool abandoned = false;
+    };
+
+    void _LookupWorker(std::shared_ptr<_Lookups> lookups) {
+        std::unique_lock<std::mutex> lock(lookups->mutex);
+        while (!lookups->abandoned && lookups->next < lookups->hosts.size()) {
+            size_t index = lookups->next++;
+            std::pair<std::string, std::string> host = lookups->hosts[index];
+            addrinfo* result = nullptr;
+            if (!host.first.empty()) {
+                lock.unlock();
+                addrinfo hints{};
+                hints.ai_family = AF_UNSPEC;
+                hints.ai_socktype = SOCK_STREAM;
+                if (getaddrinfo(host.first.c_str(), host.second.c_str(), &hints, &result) != 0) {
+                    result = nullptr;
+                }
+                lock.lock();
+            }
+            if (lookups->abandoned) {
+                if (result) freeaddrinfo(result);
+                break;
+            }
+            lookups->results[index] = result;
+            if (--lookups->pending == 0) {
+                lookups->done.notify_all();
+            }
+        }
+    }
+
+    // One address list per mirror, nullptr where the URL is invalid or the lookup
+    // failed or missed options.timeout
+    std::vector<addrinfo*> _Resolve(std::vector<Mirror>& mirrors, const ProbeOptions& options) {
+        auto lookups = std::make_shared<_Lookups>();
+        for (auto& mirror : mirrors) {
+            if (_ParseServer(mirror, options)) {
+                lookups->hosts.emplace_back(mirror.host, mirror.port);
+            }
+            else {
+                mirror.error = "Invalid server URL";
+                lookups->hosts.emplace_back();
+            }
+        }
+        lookups->results.assign(mirrors.size(), nullptr);
+        lookups->pending = mirrors.size();
+        size_t workers = std::min<size_t>(16, mirrors.size());
+        for (size_t i = 0; i < workers; ++i) {
+            std::thread(_LookupWorker, lookups).detach();
+        }
+
+        std::unique_lock<std::mutex> lock(lookups->mutex);
+        if (!lookups->done.wait_for(lock, options.timeout, [&]() { return lookups->pending == 0; })) {
+            for (size_t i = 0; i < mirrors.size(); ++i) {
+                if (!lookups->results[i] && mirrors[i].error.empty()) {
+                    mirrors[i].error = "Timed out resolving " + mirrors[i].host;
+                }
+            }
+        }
+        lookups->abandoned = true;
+        return std::move(lookups->results);
+    }
+
+    // Probes every mirror concurrently and fills in their measurements
+    void Probe(std::vector<Mirror>& mirrors, const ProbeOptions& options = ProbeOptions()) {
+        std::vector<addrinfo*> addresses = _Resolve(mirrors, options);
+        for (size_t i = 0; i < mirrors.size(); ++i) {
+            if (!addresses[i] && mirrors[i].error.empty()) {
+                mirrors[i].error = "Failed to resolve " + mirrors[i].host;
+            }
+        }
+
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd == -1) {
+            for (addrinfo* address : addresses) {
+                if (address) freeaddrinfo(address);
+            }
+            throw std::system_error(errno, std::system_category(), "Failed to create epoll instance");
+        }
+
+        std::vector<_Probe> probes(mirrors.size());
+        size_t next = 0;
+        size_t active = 0;
+        std::vector<char> buffer(64 * 1024);
+        epoll_event events[64];
+
+        while (true) {
+            // Keep up to options.concurrency probes in flight
+            while (active < options.concurrency && next < mirrors.size()) {
+                _Probe& probe = probes[next];
+                probe.mirror = &mirrors[next];
+                if (addresses[next] && _Start(probe, addresses[next], epollFd, options)) {
+                    ++active;
+                }
+                ++next;
+            }
+            if (active == 0) {
+                break;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            auto nearest = now + options.timeout;
+            for (auto& probe : probes) {
+                if (probe.fd != -1) {
+                    nearest = std::min(nearest, probe.deadline);
+                }
+            }
+            int timeout = static_cast<int>(std::max<long long>(0,
+                std::chrono::duration_cast<std::chrono::milliseconds>(nearest - now).count() + 1));
+
+            int count = epoll_wait(epollFd, events, 64, timeout);
+            if (count < 0 && errno != EINTR) {
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                _Probe& probe = *static_cast<_Probe*>(events[i].data.ptr);
+                if (probe.fd == -1) {
+                    continue;
+                }
+                bool running = true;
+                if (probe.state == _Probe::State::Receiving) {
+                    running = _OnReadable(probe, buffer.data(), buffer.size(), options.maxBytes);
+                }
+                else if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                    running = _OnWritable(probe, epollFd);
+                }
+                if (!running) {
+                    --active;
+                }
+            }
+
+            // Per mirror timeouts
+            now = std::chrono::steady_clock::now();
+            for (auto& probe : probes) {
+                if (probe.fd != -1 && now >= probe.deadline) {
+                    // A slow mirror that already delivered data is still measured
+                    _Finish(probe, probe.headerDone && probe.body > 0 ? "" : "Timed out");
+                    --active;
+                }
+            }
+        }
+
+        close(epollFd);
+        for (addrinfo* address : addresses) {
+            if (address) freeaddrinfo(address);
+        }
+    }
+
+    // Working mirrors, fastest download first and the ones only connected to after
+    // them by latency, at most count of them
+    std::vector<Mirror> Rank(std::vector<Mirror> mirrors, size_t count) {
+        mirrors.erase(std::remove_if(mirrors.begin(), mirrors.end(),
+            [](const Mirror& mirror) { return !mirror.ok; }), mirrors.end());
+        std::stable_sort(mirrors.begin(), mirrors.end(), [](const Mirror& a, const Mirror& b) {
+            if (a.bytesPerSecond != b.bytesPerSecond) {
+                return a.bytesPerSecond > b.bytesPerSecond;
+            }
+            return a.latencyMs < b.latencyMs;
+            });
+        if (mirrors.size() > count) {
+            mirrors.resize(count);
+        }
+        return mirrors;
+    }
+
+    std::string FormatMirrorlist(const std::vector<Mirror>& mirrors) {
+        std::ostringstream oss;
+        oss << "# Ranked by Arch-Installer\n";
+        for (const auto& mirror : mirrors) {
+            char rate[64];
+            std::snprintf(rate, sizeof(rate), "%.1f KiB/s, %.0f ms", mirror.bytesPerSecond / 1024.0, mirror.latencyMs);
+            oss << "# " << rate << "\n";
+            oss << "Server = " << mirror.server << "\n";
+        }
+        return oss.str();
+    }
+} // namespace Mirrors
+
+#endif /*MIRRORRANKER_H_*/
@@ -0,0 +1,248 @@
+#ifndef PACMANPROGRESS_H_
+#define PACMANPROGRESS_H_
+
+#include <ncurses.h>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+// Follows pacman/pacstrap output line by line and tracks where the transaction is
+// Piped pacman prints no progress bars, so download bytes are estimated from the
+// package count and the announced download size
+class PacmanProgress {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Phase { Preparing, Syncing, Downloading, Installing, Hooks, Done };
+
+    // Feed each line as it arrives, '\r' separated progress bar updates are split here
+    void Feed(std::string_view line, Clock::time_point now = Clock::now()) {
+        size_t start = 0;
+        while (start <= line.size()) {
+            size_t end = line.find('\r', start);
+            if (end == std::string_view::npos) {
+                end = line.size();
+            }
+            _Parse(line.substr(start, end - start), now);
+            start = end + 1;
+        }
+    }
+
+    void Finish() {
+        m_Phase = Phase::Done;
+        m_Package.clear();
+    }
+
+    inline Phase GetPhase() const { return m_Phase; }
+    inline size_t GetDone() const { return m_Done; }
+    inline size_t GetTotal() const { return m_Total; }
+    inline const std::string& GetPackage() const { return m_Package; }
+    inline const std::string& GetLastError() const { return m_LastError; }
+    inline double GetDownloadTotal() const { return m_DownloadTotal; }
+
+    // Estimated bytes downloaded so far
+    double GetDownloaded() const {
+        if (m_Phase == Phase::Downloading && m_Packages > 0 && m_Done > 0) {
+            // The package being downloaded is counted half done
+            return m_DownloadTotal * (static_cast<double>(m_Done) - 0.5) / static_cast<double>(m_Packages);
+        }
+        return m_Phase > Phase::Downloading ? m_DownloadTotal : 0.0;
+    }
+
+    double GetBytesPerSecond(Clock::time_point now = Clock::now()) const {
+        double elapsed = std::chrono::duration<double>(now - m_PhaseStart).count();
+        return m_Phase == Phase::Downloading && elapsed > 0.0 ? GetDownloaded() / elapsed : 0.0;
+    }
+
+    // Remaining seconds of the current phase at its average pace, negative if unknown
+    double GetEta(Clock::time_point now = Clock::now()) const {
+        if (m_Done == 0 || m_Total == 0 || m_Done > m_Total) {
+            return -1.0;
+        }
+        double elapsed = std::chrono::duration<double>(now - m_PhaseStart).count();
+        return elapsed / static_cast<double>(m_Done) * static_cast<double>(m_Total - m_Done);
+    }
+
+    // Draws the state into win, which should be at least 6 rows high
+    void Draw(WINDOW* win, Clock::time_point now = Clock::now()) const {
+        static const char* titles[] = { "Preparing", "Synchronizing databases", "Downloading packages",
+            "Installing packages", "Running hooks", "Done" };
+        int width = getmaxx(win);
+        werase(win);
+        box(win, 0, 0);
+        mvwprintw(win, 0, 2, " %s ", titles[static_cast<int>(m_Phase)]);
+
+        // [=====>    ] done/total
+        char count[32];
+        int countLength = m_Total > 0 ? std::snprintf(count, sizeof(count), " %zu/%zu", m_Done, m_Total) : 0;
+        int barWidth = width - 6 - countLength;
+        if (barWidth > 0) {
+            int filled = m_Total > 0 ? static_cast<int>(barWidth * std::min(m_Done, m_Total) / m_Total) : 0;
+            if (m_Phase == Phase::Done) {
+                filled = barWidth;
+            }
+            mvwaddch(win, 1, 2, '[');
+            for (int i = 0; i < barWidth; ++i) {
+                waddch(win, i < filled ? '=' : (i == filled ? '>' : ' '));
+            }
+            waddch(win, ']');
+            if (countLength > 0) {
+                waddstr(win, count);
+            }
+        }
+
+        mvwprintw(win, 2, 2, "%.*s", width - 4, m_Package.c_str());
+        if (m_DownloadTotal > 0.0) {
+            mvwprintw(win, 3, 2, "Download %s / %s  %s/s", _FormatBytes(GetDownloaded()).c_str(),
+                _FormatBytes(m_DownloadTotal).c_str(), _FormatBytes(GetBytesPerSecond(now)).c_str());
+        }
+        double eta = GetEta(now);
+        if (eta >= 0.0 && m_Phase != Phase::Done) {
+            long seconds = static_cast<long>(eta + 0.5);
+            mvwprintw(win, 4, 2, "ETA %02ld:%02ld", seconds / 60, seconds % 60);
+        }
+        if (!m_LastError.empty()) {
+            mvwprintw(win, 4, 14, "%.*s", width - 16, m_LastError.c_str());
+        }
+    }
+
+private:
+    static bool _StartsWith(std::string_view text, std::string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+
+    static bool _EndsWith(std::string_view text, std::string_view suffix) {
+        return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+    }
+
+    static std::string _FormatBytes(double bytes) {
+        static const char* units[] = { "B", "KiB", "MiB", "GiB" };
+        int unit = 0;
+        while (bytes >= 1024.0 && unit < 3) {
+            bytes /= 1024.0;
+            ++unit;
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f %s", bytes, units[unit]);
+        return text;
+    }
+
+    // "500.23 MiB" -> bytes
+    static double _ParseSize(std::string_view text) {
+        std::string value(text);
+        char* end = nullptr;
+        double size = std::strtod(value.c_str(), &end);
+        while (*end == ' ') {
+            ++end;
+        }
+        std::string_view unit(end);
+        if (_StartsWith(unit, "KiB")) return size * 1024.0;
+        if (_StartsWith(unit, "MiB")) return size * 1024.0 * 1024.0;
+        if (_StartsWith(unit, "GiB")) return size * 1024.0 * 1024.0 * 1024.0;
+        return size;
+    }
+
+    void _StartPhase(Phase phase, Clock::time_point now) {
+        m_Phase = phase;
+        m_PhaseStart = now;
+        m_Done = 0;
+        m_Total = phase == Phase::Downloading || phase == Phase::Installing ? m_Packages : 0;
+        m_Package.clear();
+    }
+
+    // "(3/120) installing linux  [###  ] 45%" -> done 3, total 120, rest "installing linux  [###  ] 45%"
+    bool _Counter(std::string_view& line) {
+        if (!_StartsWith(line, "(")) {
+            return false;
+        }
+        size_t slash = line.find('/');
+        size_t close = line.find(')');
+        if (slash == std::string_view::npos || close == std::string_view::npos || slash > close) {
+            return false;
+        }
+        m_Done = std::strtoul(std::string(line.substr(1, slash - 1)).c_str(), nullptr, 10);
+        m_Total = std::strtoul(std::string(line.substr(slash + 1, close - slash - 1)).c_str(), nullptr, 10);
+        line.remove_prefix(std::min(line.size(), close + 2));
+        return true;
+    }
+
+    void _Parse(std::string_view line, Clock::time_point now) {
+        size_t first = line.find_first_not_of(' ');
+        if (first == std::string_view::npos) {
+            return;
+        }
+        line.remove_prefix(first);
+
+        if (_StartsWith(line, "error:")) {
+            m_LastError.assign(line);
+        }
+        else if (_StartsWith(line, ":: Synchronizing package databases")) {
+            _StartPhase(Phase::Syncing, now);
+        }
+        else if (_StartsWith(line, "Packages (")) {
+            m_Packages = std::strtoul(std::string(line.substr(10)).c_str(), nullptr, 10);
+            m_Phase = Phase::Preparing;
+        }
+        else if (_StartsWith(line, "Total Download Size:")) {
+            m_DownloadTotal = _ParseSize(line.substr(line.find(':') + 1));
+        }
+        else if (_StartsWith(line, ":: Retrieving packages")) {
+            _StartPhase(Phase::Downloading, now);
+        }
+        else if (_StartsWith(line, ":: Processing package changes")) {
+            _StartPhase(Phase::Installing, now);
+        }
+        else if (_StartsWith(line, ":: Running post-transaction hooks")) {
+            _StartPhase(Phase::Hooks, now);
+        }
+        else if (_StartsWith(line, "there is nothing to do")) {
+            Finish();
+        }
+        else if (m_Phase == Phase::Downloading || m_Phase == Phase::Syncing) {
+            // " linux-6.6.1-x86_64 downloading..." starts the next download
+            if (_EndsWith(line, " downloading...")) {
+                ++m_Done;
+                m_Package.assign(line.substr(0, line.size() - 15));
+            }
+        }
+        else if (m_Phase == Phase::Installing) {
+            // "(3/120) installing linux" with a terminal, "installing linux..." through a pipe
+            bool counted = _Counter(line);
+            for (std::string_view action : { "installing ", "upgrading ", "reinstalling ", "downgrading ", "removing " }) {
+                if (_StartsWith(line, action)) {
+                    std::string_view name = line.substr(action.size());
+                    if (_EndsWith(name, "...")) {
+                        name.remove_suffix(3);
+                    }
+                    name = name.substr(0, name.find(' '));
+                    if (!counted && m_Package != name) {
+                        ++m_Done;
+                    }
+                    m_Package.assign(name);
+                    break;
+                }
+            }
+        }
+        else if (m_Phase == Phase::Hooks) {
+            // "(2/5) Creating temporary files..."
+            if (_Counter(line)) {
+                m_Package.assign(line);
+            }
+        }
+    }
+
+private:
+    Phase m_Phase = Phase::Preparing;
+    Clock::time_point m_PhaseStart = Clock::now();
+    size_t m_Packages = 0;          // From "Packages (N)"
+    size_t m_Done = 0;
+    size_t m_Total = 0;
+    double m_DownloadTotal = 0.0;   // Bytes, from "Total Download Size:"
+    std::string m_Package;
+    std::string m_LastError;
+};
+
+#endif /*PACMANPROGRESS_H_*/
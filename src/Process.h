@@ -0,0 +1,187 @@
+#ifndef PROCESS_H_
+#define PROCESS_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <system_error>
+#include <cstdlib>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+extern char** environ;
+
+// Process launching on top of posix_spawn, which glibc implements with
+// vfork semantics so the parent's page tables are never copied
+namespace Process
+{
+    // How a child ended
+    struct Result {
+        int exitCode = -1;  // Valid when signal is 0
+        int signal = 0;     // Terminating signal, 0 if the child exited
+        std::chrono::nanoseconds wallTime{ 0 };
+        struct rusage usage {};
+
+        inline bool Success() const { return signal == 0 && exitCode == 0; }
+    };
+
+    // File actions and attributes applied in the child before exec
+    class SpawnOptions {
+    public:
+        SpawnOptions() {
+            posix_spawn_file_actions_init(&m_Actions);
+            posix_spawnattr_init(&m_Attr);
+
+            // Start from a clean signal state whatever the calling thread has
+            sigset_t signals;
+            sigemptyset(&signals);
+            posix_spawnattr_setsigmask(&m_Attr, &signals);
+            sigfillset(&signals);
+            posix_spawnattr_setsigdefault(&m_Attr, &signals);
+            m_Flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+            posix_spawnattr_setflags(&m_Attr, m_Flags);
+        }
+        ~SpawnOptions() {
+            posix_spawn_file_actions_destroy(&m_Actions);
+            posix_spawnattr_destroy(&m_Attr);
+        }
+        SpawnOptions(const SpawnOptions&) = delete;
+        SpawnOptions& operator=(const SpawnOptions&) = delete;
+
+        // Make fd available as target in the child, clears close-on-exec
+        void Dup2(int fd, int target) {
+            _Check(posix_spawn_file_actions_adddup2(&m_Actions, fd, target));
+        }
+
+        void Close(int fd) {
+            _Check(posix_spawn_file_actions_addclose(&m_Actions, fd));
+        }
+
+        void Open(int target, const char* path, int flags, mode_t mode = 0) {
+            _Check(posix_spawn_file_actions_addopen(&m_Actions, target, path, flags, mode));
+            m_HasOpen = true;
+        }
+
+        // setsid() before the file actions, opening a tty then makes it the controlling one
+        void NewSession() {
+            m_Flags |= POSIX_SPAWN_SETSID;
+            posix_spawnattr_setflags(&m_Attr, m_Flags);
+        }
+
+        inline const posix_spawn_file_actions_t* GetActions() const { return &m_Actions; }
+        // An open can fail with the same errno as a missing command
+        inline bool HasOpen() const { return m_HasOpen; }
+        inline const posix_spawnattr_t* GetAttr() const { return &m_Attr; }
+
+    private:
+        static void _Check(int error) {
+            if (error != 0) {
+                throw std::system_error(error, std::system_category(), "Failed to set up spawn options");
+            }
+        }
+
+    private:
+        posix_spawn_file_actions_t m_Actions;
+        posix_spawnattr_t m_Attr;
+        short m_Flags = 0;
+        bool m_HasOpen = false;
+    };
+
+    // A started child, Wait must be called once to reap it
+    class Child {
+    public:
+        Child() = default;
+        Child(pid_t pid, int spawnError) :
+            m_Pid(pid), m_SpawnError(spawnError), m_Start(std::chrono::steady_clock::now()) {}
+
+        // Blocks until the child ends, a child that never started exits with 127
+        Result Wait() {
+            Result result;
+            if (m_Pid <= 0) {
+                result.exitCode = m_SpawnError == EACCES ? 126 : 127;
+                return result;
+            }
+
+            int status = 0;
+            while (wait4(m_Pid, &status, 0, &result.usage) == -1) {
+                if (errno != EINTR) {
+                    throw std::system_error(errno, std::system_category(), "Failed to wait for child");
+                }
+            }
+            result.wallTime = std::chrono::steady_clock::now() - m_Start;
+            if (WIFSIGNALED(status)) {
+                result.signal = WTERMSIG(status);
+            }
+            else {
+                result.exitCode = WEXITSTATUS(status);
+            }
+            m_Pid = -1;
+            return result;
+        }
+
+        inline pid_t GetPid() const { return m_Pid; }
+        // errno of a failed exec, 0 if the child is running
+        inline int GetSpawnError() const { return m_SpawnError; }
+
+    private:
+        pid_t m_Pid = -1;
+        int m_SpawnError = 0;
+        std::chrono::steady_clock::time_point m_Start;
+    };
+
+    // Whether cmd names an executable file, searched in PATH like posix_spawnp does
+    bool _IsExecutable(const std::string& cmd) {
+        if (cmd.find('/') != std::string::npos) {
+            return access(cmd.c_str(), X_OK) == 0;
+        }
+        const char* path = std::getenv("PATH");
+        std::string dirs = path ? path : "/bin:/usr/bin";
+        size_t start = 0;
+        while (start <= dirs.size()) {
+            size_t end = dirs.find(':', start);
+            if (end == std::string::npos) {
+                end = dirs.size();
+            }
+            std::string dir = end > start ? dirs.substr(start, end - start) : ".";
+            if (access((dir + "/" + cmd).c_str(), X_OK) == 0) {
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    // Starts cmd, searched in PATH, argv[0] is cmd itself
+    // A missing or non executable cmd gives a Child that reports 127/126
+    // Might throw std::system_error, also when a file action such as Open failed
+    Child Spawn(const std::string& cmd, const std::vector<std::string>& args, const SpawnOptions& options) {
+        std::vector<char*> argv;
+        argv.reserve(args.size() + 2);
+        argv.push_back(const_cast<char*>(cmd.c_str()));
+        for (const auto& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        pid_t pid = -1;
+        int error = posix_spawnp(&pid, cmd.c_str(), options.GetActions(), options.GetAttr(), argv.data(), environ);
+        if (error == ENOENT || error == EACCES || error == ENOEXEC || error == ENOTDIR) {
+            if (options.HasOpen() && error != ENOEXEC && _IsExecutable(cmd)) {
+                // The command is there, so an opened file is what's missing or denied
+                throw std::system_error(error, std::system_category(), "Failed to open the files of " + cmd);
+            }
+            return Child(-1, error);
+        }
+        if (error != 0) {
+            throw std::system_error(error, std::system_category(), "Failed to spawn " + cmd);
+        }
+        return Child(pid, 0);
+    }
+} // namespace Process
+
+#endif /*PROCESS_H_*/
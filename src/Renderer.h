@@ -5,19 +5,55 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 
-using WinHandle = int;
+// Slot index plus the generation the slot had when the layer was created, so a
+// handle to a destroyed layer never reaches whatever reuses its slot
+struct WinHandle {
+    uint32_t index = UINT32_MAX;
+    uint32_t generation = 0;
+
+    inline bool IsValid() const { return index != UINT32_MAX; }
+    inline bool operator==(const WinHandle& other) const { return index == other.index && generation == other.generation; }
+    inline bool operator!=(const WinHandle& other) const { return !(*this == other); }
+};
+
+// Geometry relative to the parent layer, or to the screen for a top level layer,
+// recomputed by Renderer::OnResize
+struct Layout {
+    // Insets from the parent's edges
+    int top = 0;
+    int bottom = 0;
+    int left = 0;
+    int right = 0;
+    // Fixed size, 0 fills what the insets leave, larger is clamped to it
+    int height = 0;
+    int width = 0;
+    // A fixed size layer sits in the middle of what the insets leave
+    bool center = false;
+};
 
 struct LayerProp {
-    WINDOW* layer;
-    int order;
+    WINDOW* layer = nullptr;
     int height;
     int width;
     int starty;
     int startx;
     // childs cant have childs
-    WinHandle parent = -1;
-    WinHandle child = -1;
+    WinHandle parent;
+    WinHandle child;
+    // Set by MarkDirty, ncurses' own touch flags are honored as well
+    bool dirty = true;
+    // Layers created from a Layout follow the terminal size
+    bool managed = false;
+    Layout layout;
 
     LayerProp(int height, int width, int starty, int startx) :
         height(height), width(width), starty(starty), startx(startx) {}
@@ -27,108 +63,218 @@ class Renderer {
 public:
     Renderer() = default;
     ~Renderer() {
-        if (m_Layers.size() > 0) {
-            for (auto& layer : m_Layers) {
-                delwin(layer.layer);
+        // Subwindows go before the windows they were derived from
+        for (int pass = 0; pass < 2; ++pass) {
+            for (auto& slot : m_Slots) {
+                if (slot.alive && slot.prop.parent.IsValid() == (pass == 0)) {
+                    delwin(slot.prop.layer);
+                }
             }
         }
+        if (m_IoFd != -1) {
+            close(m_IoFd);
+        }
         endwin();
     }
     void Init() {
         initscr();
         curs_set(0);
+        m_Lines = LINES;
+        m_Cols = COLS;
+        // Per thread write accounting, so every OnUpdate must run on this thread
+        m_IoFd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+        m_Thread = std::this_thread::get_id();
     }
 
+    // nullptr for a destroyed or never created layer
     WINDOW* GetWindowPtr(WinHandle handle) {
-        if (handle < 0 || handle >= m_Layers.size()) {
-            return nullptr;
-        }
-        return m_Layers[handle].layer;
+        LayerProp* layer = _Get(handle);
+        return layer ? layer->layer : nullptr;
     }
 
+    // 1 is the bottom, orders past the top clamp to it
     void ChangeLayerOrder(WinHandle handle, unsigned int newOrder) {
-        if (m_Layers.size() == 1) {
+        if (!_Get(handle) || m_Count == 1) {
             return;
         }
-        // Clamping the new order within the bounds of the order vector
-        newOrder = std::min(newOrder, static_cast<unsigned int>(m_OrderVector.size()));
-        newOrder = newOrder == 0 ? 1 : newOrder;
-
-        // If the new order is the same as the current order, do nothing
-        if (newOrder == m_Layers[handle].order) {
+        newOrder = std::clamp(newOrder, 1u, static_cast<unsigned int>(m_Count));
+        if (newOrder == static_cast<unsigned int>(GetLayerOrder(handle))) {
             return; // No change in order
         }
+        _Unlink(handle.index);
+        // Insert below the layer now at newOrder, or on top
+        uint32_t above = m_Bottom;
+        for (unsigned int order = 1; order < newOrder && above != _None; ++order) {
+            above = m_Slots[above].next;
+        }
+        _LinkBelow(handle.index, above);
+    }
 
-        // Find the current position of the layer in the order vector
-        auto it = std::find(m_OrderVector.begin(), m_OrderVector.end(), handle);
-        if (it == m_OrderVector.end()) {
-            return; // Handle not found
+    // The whole layer is restaged on the next update, not only its changed lines,
+    // for when something that covered it went away
+    void MarkDirty(WinHandle handle) {
+        if (LayerProp* layer = _Get(handle)) {
+            layer->dirty = true;
         }
+    }
 
-        // Remove the handle from its current position
-        m_OrderVector.erase(it);
+    // Stages the changed layers and writes them to the terminal in one go
+    // Only from the thread that called Init, like the rest of ncurses
+    void OnUpdate() {
+        assert((m_IoFd == -1 || std::this_thread::get_id() == m_Thread) && "Renderer used off its thread");
+        std::vector<WINDOW*> staged;
+        for (uint32_t index = m_Bottom; index != _None; index = m_Slots[index].next) {
+            LayerProp& layer = m_Slots[index].prop;
+            if (layer.dirty) {
+                touchwin(layer.layer); // wnoutrefresh only copies touched lines
+            }
+            bool stage = layer.dirty || is_wintouched(layer.layer);
+            if (!stage) {
+                // A lower layer that was restaged may have painted over this one
+                for (WINDOW* below : staged) {
+                    if (_Overlaps(below, layer.layer)) {
+                        touchwin(layer.layer);
+                        stage = true;
+                        break;
+                    }
+                }
+            }
+            if (stage) {
+                wnoutrefresh(layer.layer);
+                layer.dirty = false;
+                staged.push_back(layer.layer);
+            }
+        }
 
-        // Insert the handle at the new position
-        auto newIt = m_OrderVector.begin() + (newOrder - 1);
-        m_OrderVector.insert(newIt, handle);
+        if (staged.empty()) {
+            m_LastFrameBytes = 0;
+            return;
+        }
+        size_t before = _WrittenBytes();
+        doupdate();
+        m_LastFrameBytes = _WrittenBytes() - before;
+    }
 
-        // Update the order in the Layer object
-        for (int i = 0; i < m_OrderVector.size(); ++i) {
-            m_Layers[m_OrderVector[i]].order = i + 1;
+    // Bytes the last OnUpdate wrote to the terminal, 0 if nothing changed
+    // Measured as the growth of the calling thread's wchar across doupdate, which
+    // is only terminal output because nothing else runs on the thread meanwhile.
+    // That is the thread from Init, a Renderer used from another one would count
+    // the wrong thread's writes.
+    inline size_t GetLastFrameBytes() const {
+        return m_LastFrameBytes;
+    }
+
+    WinHandle CreateLayer(const Layout& layout) {
+        int height, width, starty, startx;
+        _Place(layout, LINES, COLS, height, width, starty, startx);
+        WinHandle handle = CreateLayer(height, width, starty, startx);
+        _Manage(handle, layout);
+        return handle;
+    }
+
+    WinHandle CreateSubLayer(WinHandle parent, const Layout& layout) {
+        LayerProp* parentLayer = _Get(parent);
+        if (!parentLayer) {
+            return WinHandle();
         }
+        int height, width, starty, startx;
+        _Place(layout, parentLayer->height, parentLayer->width, height, width, starty, startx);
+        WinHandle handle = CreateSubLayer(parent, height, width, starty, startx);
+        _Manage(handle, layout);
+        return handle;
     }
 
-    void OnUpdate() {
-        for (auto& index : m_OrderVector) {
-            wrefresh(m_Layers[index].layer);
+    // Call when SIGWINCH arrived, returns false if the size didn't change
+    // Layers created from a Layout are resized and moved when their geometry
+    // changed, parents before children, everything is redrawn on the next update
+    bool OnResize() {
+        struct winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_row == 0 || size.ws_col == 0) {
+            return false;
+        }
+        // ncurses may have followed the size already when resuming after endwin,
+        // so compare against what the layers were laid out for
+        if (size.ws_row == m_Lines && size.ws_col == m_Cols) {
+            return false;
+        }
+        resizeterm(size.ws_row, size.ws_col);
+        m_Lines = size.ws_row;
+        m_Cols = size.ws_col;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (auto& slot : m_Slots) {
+                if (slot.alive && slot.prop.managed && slot.prop.parent.IsValid() == (pass == 1)) {
+                    _Relayout(slot.prop);
+                }
+            }
+        }
+        clearok(curscr, TRUE); // What is on the terminal can't be trusted now
+        for (auto& slot : m_Slots) {
+            slot.prop.dirty = true;
         }
+        return true;
     }
 
     WinHandle CreateLayer(int height, int width, int starty, int startx) {
         LayerProp layer(height, width, starty, startx);
         layer.layer = newwin(height, width, starty, startx);
         if (layer.layer == nullptr) throw std::bad_alloc();
-        layer.order = m_Layers.size() + 1;
-        m_Layers.push_back(layer);
-        m_OrderVector.push_back(m_Layers.size() - 1);
-        return m_Layers.size() - 1;
+        return _Insert(layer);
     }
 
+    // Invalid handle if parent is gone or already part of a parent/child pair
     WinHandle CreateSubLayer(WinHandle parent, int height, int width, int starty, int startx) {
-        if (parent < 0 || parent >= m_Layers.size()) {
-            return -1;
-        }
-        if (m_Layers[parent].child != -1 || m_Layers[parent].parent != -1) {
-            return -1;
+        LayerProp* parentLayer = _Get(parent);
+        if (!parentLayer || parentLayer->child.IsValid() || parentLayer->parent.IsValid()) {
+            return WinHandle();
         }
         LayerProp layer(height, width, starty, startx);
-        layer.layer = derwin(m_Layers[parent].layer, height, width, starty, startx);
+        layer.layer = derwin(parentLayer->layer, height, width, starty, startx);
         if (layer.layer == nullptr) throw std::bad_alloc();
-        layer.order = m_Layers.size() + 1;
         layer.parent = parent;
-        m_Layers[parent].child = m_Layers.size();
-        m_Layers.push_back(layer);
-        m_OrderVector.push_back(m_Layers.size() - 1);
-        return m_Layers.size() - 1;
+        WinHandle handle = _Insert(layer);
+        _Get(parent)->child = handle; // _Insert may have moved the slots
+        return handle;
     }
 
+    // Other handles stay valid, this one and its child's become stale
+    // The layers it covered are marked dirty, so they are redrawn in its place
     void DestroyLayer(WinHandle handle) {
-        if (m_Layers.size() == 1) {
+        LayerProp* layer = _Get(handle);
+        if (!layer) {
             return;
         }
-        if (m_Layers[handle].child != -1) {
-            DestroyLayer(m_Layers[handle].child);
+        if (layer->child.IsValid()) {
+            DestroyLayer(layer->child);
+        }
+        if (LayerProp* parent = _Get(layer->parent)) {
+            parent->child = WinHandle();
         }
-        if (m_Layers[handle].parent != -1) {
-            m_Layers[m_Layers[handle].parent].child = -1;
+        for (uint32_t index = m_Slots[handle.index].prev; index != _None; index = m_Slots[index].prev) {
+            LayerProp& below = m_Slots[index].prop;
+            if (_Overlaps(below.layer, layer->layer)) {
+                below.dirty = true;
+            }
         }
-        delwin(m_Layers[handle].layer);
-        m_Layers.erase(m_Layers.begin() + handle);
-        m_OrderVector.erase(std::find(m_OrderVector.begin(), m_OrderVector.end(), handle));
+        delwin(layer->layer);
+        _Unlink(handle.index);
+        _Slot& slot = m_Slots[handle.index];
+        slot.alive = false;
+        ++slot.generation;
+        slot.next = m_FreeHead;
+        m_FreeHead = handle.index;
+        --m_Count;
     }
 
-    inline int GetLayerOrder(WinHandle handle) {
-        return m_Layers[handle].order;
+    // Position from the bottom starting at 1, 0 for a stale handle
+    int GetLayerOrder(WinHandle handle) {
+        if (!_Get(handle)) {
+            return 0;
+        }
+        int order = 1;
+        for (uint32_t index = m_Bottom; index != handle.index; index = m_Slots[index].next) {
+            ++order;
+        }
+        return order;
     }
 
     inline void StopRenderer() {
@@ -137,9 +283,157 @@ public:
     }
 
 private:
-    std::vector<LayerProp> m_Layers;
-    std::vector<WinHandle> m_OrderVector;
+    static constexpr uint32_t _None = UINT32_MAX;
+
+    // Live slots are linked bottom to top in z-order, free ones through next
+    struct _Slot {
+        LayerProp prop;
+        uint32_t generation = 0;
+        bool alive = false;
+        uint32_t prev = _None;
+        uint32_t next = _None;
+
+        _Slot(const LayerProp& prop) : prop(prop) {}
+    };
+
+    static void _Place(const Layout& layout, int parentHeight, int parentWidth,
+        int& height, int& width, int& starty, int& startx) {
+        auto axis = [&layout](int parent, int before, int after, int fixed, int& size, int& start) {
+            int space = std::max(1, parent - before - after);
+            size = fixed > 0 ? std::min(fixed, space) : space;
+            start = before + (layout.center ? (space - size) / 2 : 0);
+            };
+        axis(parentHeight, layout.top, layout.bottom, layout.height, height, starty);
+        axis(parentWidth, layout.left, layout.right, layout.width, width, startx);
+    }
+
+    void _Manage(WinHandle handle, const Layout& layout) {
+        if (LayerProp* layer = _Get(handle)) {
+            layer->managed = true;
+            layer->layout = layout;
+        }
+    }
+
+    // Only touches the window if its geometry changed
+    void _Relayout(LayerProp& layer) {
+        LayerProp* parent = _Get(layer.parent);
+        int height, width, starty, startx;
+        _Place(layer.layout, parent ? parent->height : LINES, parent ? parent->width : COLS,
+            height, width, starty, startx);
+        if (height == layer.height && width == layer.width && starty == layer.starty && startx == layer.startx) {
+            return;
+        }
+        wresize(layer.layer, height, width);
+        if (parent) {
+            mvderwin(layer.layer, starty, startx);
+        }
+        else {
+            mvwin(layer.layer, starty, startx);
+        }
+        layer.height = height;
+        layer.width = width;
+        layer.starty = starty;
+        layer.startx = startx;
+    }
+
+    LayerProp* _Get(WinHandle handle) {
+        if (handle.index >= m_Slots.size()) {
+            return nullptr;
+        }
+        _Slot& slot = m_Slots[handle.index];
+        return slot.alive && slot.generation == handle.generation ? &slot.prop : nullptr;
+    }
+
+    // Takes a free slot if there is one and puts the layer on top
+    WinHandle _Insert(const LayerProp& layer) {
+        uint32_t index;
+        if (m_FreeHead != _None) {
+            index = m_FreeHead;
+            m_FreeHead = m_Slots[index].next;
+            m_Slots[index].prop = layer;
+        }
+        else {
+            index = static_cast<uint32_t>(m_Slots.size());
+            m_Slots.emplace_back(layer);
+        }
+        m_Slots[index].alive = true;
+        _LinkBelow(index, _None);
+        ++m_Count;
+        return WinHandle{ index, m_Slots[index].generation };
+    }
+
+    // Links index right below above, _None puts it on top
+    void _LinkBelow(uint32_t index, uint32_t above) {
+        _Slot& slot = m_Slots[index];
+        slot.next = above;
+        slot.prev = above == _None ? m_Top : m_Slots[above].prev;
+        if (slot.prev == _None) {
+            m_Bottom = index;
+        }
+        else {
+            m_Slots[slot.prev].next = index;
+        }
+        if (above == _None) {
+            m_Top = index;
+        }
+        else {
+            m_Slots[above].prev = index;
+        }
+    }
+
+    void _Unlink(uint32_t index) {
+        _Slot& slot = m_Slots[index];
+        if (slot.prev == _None) {
+            m_Bottom = slot.next;
+        }
+        else {
+            m_Slots[slot.prev].next = slot.next;
+        }
+        if (slot.next == _None) {
+            m_Top = slot.prev;
+        }
+        else {
+            m_Slots[slot.next].prev = slot.prev;
+        }
+        slot.prev = _None;
+        slot.next = _None;
+    }
+
+    static bool _Overlaps(WINDOW* a, WINDOW* b) {
+        int ay, ax, by, bx;
+        getbegyx(a, ay, ax);
+        getbegyx(b, by, bx);
+        return ay < by + getmaxy(b) && by < ay + getmaxy(a) &&
+            ax < bx + getmaxx(b) && bx < ax + getmaxx(a);
+    }
+
+    size_t _WrittenBytes() const {
+        if (m_IoFd == -1) {
+            return 0;
+        }
+        char buffer[512];
+        ssize_t count = pread(m_IoFd, buffer, sizeof(buffer) - 1, 0);
+        if (count <= 0) {
+            return 0;
+        }
+        buffer[count] = '\0';
+        const char* wchar = std::strstr(buffer, "wchar:");
+        return wchar ? std::strtoull(wchar + 6, nullptr, 10) : 0;
+    }
+
+private:
+    std::vector<_Slot> m_Slots;
+    uint32_t m_FreeHead = _None;
+    uint32_t m_Bottom = _None;
+    uint32_t m_Top = _None;
+    size_t m_Count = 0;
+    // Screen size the layers are laid out for
+    int m_Lines = 0;
+    int m_Cols = 0;
     bool m_Running = true;
+    int m_IoFd = -1;
+    std::thread::id m_Thread; // The one that called Init
+    size_t m_LastFrameBytes = 0;
 };
 
 #endif /*RENDERER_H_*/
@@ -0,0 +1,162 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+
+// Runs named tasks on a pool as soon as all of their inputs are ready
+// An input is either another task or a fact handed in with Provide,
+// such as an operator answer. A failed input fails its dependents.
+class Scheduler {
+public:
+    explicit Scheduler(ThreadPool& pool) :
+        m_Pool(pool) {}
+
+    // Waits for the tasks already running, nothing new is started meanwhile
+    ~Scheduler() {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Stopping = true;
+        m_CondVar.wait(lock, [this]() { return m_Running == 0; });
+    }
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    void Add(const std::string& name, const std::vector<std::string>& inputs, std::function<void()> task) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        _Node& node = m_Nodes[name];
+        if (node.task || node.done) {
+            throw std::invalid_argument("Task already exists: " + name);
+        }
+        node.task = std::move(task);
+        node.waiting = 0;
+        for (const auto& input : inputs) {
+            _Node& dependency = m_Nodes[input];
+            if (dependency.done) {
+                if (dependency.error && !node.error) {
+                    node.error = dependency.error;
+                }
+                continue;
+            }
+            dependency.dependents.push_back(name);
+            ++node.waiting;
+        }
+        _Ready(name, node);
+    }
+
+    // Marks an input that is produced outside the scheduler as ready
+    void Provide(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        _Node& node = m_Nodes[name];
+        if (node.done || node.task) {
+            return;
+        }
+        _Complete(name, nullptr);
+    }
+
+    inline bool Has(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_Nodes.find(name);
+        return it != m_Nodes.end() && (it->second.task || it->second.done);
+    }
+
+    // Like Wait, but gives up after timeout and returns false if the task is still going
+    bool WaitFor(const std::string& name, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        auto it = m_Nodes.find(name);
+        if (it == m_Nodes.end()) {
+            throw std::invalid_argument("Unknown task: " + name);
+        }
+        if (!m_CondVar.wait_for(lock, timeout, [&]() { return it->second.done; })) {
+            return false;
+        }
+        if (it->second.error) {
+            std::rethrow_exception(it->second.error);
+        }
+        return true;
+    }
+
+    // Blocks until the task finished, rethrows whatever it threw
+    void Wait(const std::string& name) {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        auto it = m_Nodes.find(name);
+        if (it == m_Nodes.end()) {
+            throw std::invalid_argument("Unknown task: " + name);
+        }
+        m_CondVar.wait(lock, [&]() { return it->second.done; });
+        if (it->second.error) {
+            std::rethrow_exception(it->second.error);
+        }
+    }
+
+private:
+    struct _Node {
+        std::function<void()> task;
+        std::vector<std::string> dependents;
+        size_t waiting = 0;
+        bool started = false;
+        bool done = false;
+        std::exception_ptr error;
+    };
+
+    // Called with the lock held
+    void _Ready(const std::string& name, _Node& node) {
+        if (node.waiting > 0 || node.started || !node.task || m_Stopping) {
+            return;
+        }
+        node.started = true;
+        if (node.error) { // An input failed, skip the work
+            _Complete(name, node.error);
+            return;
+        }
+        ++m_Running;
+        m_Pool.Submit([this, name, task = node.task]() {
+            std::exception_ptr error;
+            try {
+                task();
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            _Complete(name, error);
+            --m_Running;
+            m_CondVar.notify_all();
+            });
+    }
+
+    // Called with the lock held
+    void _Complete(const std::string& name, std::exception_ptr error) {
+        _Node& node = m_Nodes[name];
+        node.done = true;
+        node.error = error;
+        for (const auto& dependentName : node.dependents) {
+            _Node& dependent = m_Nodes[dependentName];
+            if (error && !dependent.error) {
+                dependent.error = error;
+            }
+            --dependent.waiting;
+            _Ready(dependentName, dependent);
+        }
+        m_CondVar.notify_all();
+    }
+
+private:
+    ThreadPool& m_Pool;
+    std::map<std::string, _Node> m_Nodes;
+    std::mutex m_Mutex;
+    std::condition_variable m_CondVar;
+    size_t m_Running = 0;
+    bool m_Stopping = false;
+};
+
+#endif /*SCHEDULER_H_*/
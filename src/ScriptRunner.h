@@ -0,0 +1,123 @@
+#ifndef SCRIPTRUNNER_H_
+#define SCRIPTRUNNER_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <future>
+#include <functional>
+#include <stdexcept>
+
+#include "CommandScript.h"
+#include "Process.h"
+
+// Executes a step of the Commands script, stopping at the first failure
+namespace Script
+{
+    using Resolver = std::function<std::string(std::string_view name)>;
+    using Executor = std::function<Process::Result(const std::string& command, const std::string& args)>;
+
+    // Replaces every ${name} with resolve(name), a lone '$' is kept as is
+    std::string Substitute(std::string_view text, const Resolver& resolve) {
+        std::string result;
+        result.reserve(text.size());
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t start = text.find("${", pos);
+            if (start == std::string_view::npos) {
+                result.append(text.substr(pos));
+                break;
+            }
+            size_t end = text.find('}', start + 2);
+            if (end == std::string_view::npos) {
+                throw std::runtime_error("Unterminated variable in: " + std::string(text));
+            }
+            result.append(text.substr(pos, start - pos));
+            result.append(resolve(text.substr(start + 2, end - start - 2)));
+            pos = end + 1;
+        }
+        return result;
+    }
+
+    class Runner {
+    public:
+        // parallel false runs groups one command at a time, e.g. for dry runs
+        Runner(Resolver resolve, Executor execute, bool parallel = true) :
+            m_Resolve(std::move(resolve)), m_Execute(std::move(execute)), m_Parallel(parallel) {}
+
+        // Throws std::runtime_error naming the first command that failed
+        void Run(CommandScript::StepView step) {
+            const CommandRecord* it = step.begin();
+            while (it != step.end()) {
+                // A group is the run of records sharing its non zero id
+                const CommandRecord* groupEnd = it + 1;
+                if (it->group != 0) {
+                    while (groupEnd != step.end() && groupEnd->group == it->group) {
+                        ++groupEnd;
+                    }
+                }
+
+                // Resolve everything up front, resolvers may prompt the operator
+                std::vector<_Command> commands;
+                for (const CommandRecord* record = it; record != groupEnd; ++record) {
+                    commands.push_back({ Substitute(record->command, m_Resolve), Substitute(record->args, m_Resolve) });
+                }
+
+                if (commands.size() == 1 || !m_Parallel) {
+                    for (const auto& command : commands) {
+                        _Check(command, m_Execute(command.command, command.args));
+                    }
+                }
+                else {
+                    _RunParallel(commands);
+                }
+                it = groupEnd;
+            }
+        }
+
+    private:
+        struct _Command {
+            std::string command;
+            std::string args;
+        };
+
+        // Every command of the group finishes before the first failure is reported
+        void _RunParallel(const std::vector<_Command>& commands) {
+            std::vector<std::future<Process::Result>> running;
+            for (const auto& command : commands) {
+                running.push_back(std::async(std::launch::async, m_Execute, command.command, command.args));
+            }
+            std::exception_ptr failure;
+            for (size_t i = 0; i < running.size(); ++i) {
+                try {
+                    _Check(commands[i], running[i].get());
+                }
+                catch (...) {
+                    if (!failure) {
+                        failure = std::current_exception();
+                    }
+                }
+            }
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+        }
+
+        static void _Check(const _Command& command, const Process::Result& result) {
+            if (result.Success()) {
+                return;
+            }
+            std::string reason = result.signal != 0 ? "killed by signal " + std::to_string(result.signal)
+                : "exit code " + std::to_string(result.exitCode);
+            throw std::runtime_error("Command failed (" + reason + "): " + command.command
+                + (command.args.empty() ? "" : " " + command.args));
+        }
+
+    private:
+        Resolver m_Resolve;
+        Executor m_Execute;
+        bool m_Parallel;
+    };
+} // namespace Script
+
+#endif /*SCRIPTRUNNER_H_*/
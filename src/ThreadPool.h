@@ -0,0 +1,78 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+// Fixed size pool, Submit hands back a future for the task's result
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            m_Workers.emplace_back(&ThreadPool::_Worker, this);
+        }
+    }
+
+    // Finishes the queued tasks before joining
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_CondVar.notify_all();
+        for (auto& worker : m_Workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename F>
+    std::future<std::invoke_result_t<F>> Submit(F&& fn) {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+        std::future<Result> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.emplace([task]() { (*task)(); });
+        }
+        m_CondVar.notify_one();
+        return future;
+    }
+
+private:
+    void _Worker() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_CondVar.wait(lock, [this]() { return m_Stopping || !m_Tasks.empty(); });
+                if (m_Tasks.empty()) {
+                    return;
+                }
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop();
+            }
+            task();
+        }
+    }
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_CondVar;
+    bool m_Stopping = false;
+};
+
+#endif /*THREADPOOL_H_*/
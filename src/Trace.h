@@ -0,0 +1,187 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "Process.h"
+
+// Span recorder dumped as Chrome/Perfetto trace-event JSON
+// Recording is a slot claim in a preallocated buffer, no lock is taken
+namespace Trace
+{
+    struct Span {
+        const char* category = "";
+        std::string name;
+        long long start = 0;    // Microseconds since the tracer was enabled
+        long long duration = 0;
+        long tid = 0;
+        // From wait4 for spans covering a child process
+        bool hasUsage = false;
+        double userMs = 0.0;
+        double systemMs = 0.0;
+        long maxRssKb = 0;
+        int exitCode = 0;
+    };
+
+    class Tracer {
+    public:
+        static constexpr size_t Capacity = 1 << 16;
+
+        static inline Tracer& Get() {
+            static Tracer instance;
+            return instance;
+        }
+
+        void Enable(const std::string& filePath) {
+            m_FilePath = filePath;
+            m_Spans.reset(new Span[Capacity]);
+            m_Ready.reset(new std::atomic<bool>[Capacity]);
+            for (size_t i = 0; i < Capacity; ++i) {
+                m_Ready[i].store(false, std::memory_order_relaxed);
+            }
+            m_Epoch = std::chrono::steady_clock::now();
+            m_Enabled.store(true, std::memory_order_release);
+        }
+
+        inline bool IsEnabled() const {
+            return m_Enabled.load(std::memory_order_acquire);
+        }
+
+        inline long long Now() const {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - m_Epoch).count();
+        }
+
+        // Spans past the capacity are counted and dropped
+        void Record(Span&& span) {
+            if (!IsEnabled()) {
+                return;
+            }
+            size_t slot = m_Count.fetch_add(1, std::memory_order_relaxed);
+            if (slot >= Capacity) {
+                return;
+            }
+            m_Spans[slot] = std::move(span);
+            m_Ready[slot].store(true, std::memory_order_release);
+        }
+
+        // Writes every finished span, returns false if the file can't be written
+        bool Dump() {
+            if (!IsEnabled()) {
+                return true;
+            }
+            FILE* file = std::fopen(m_FilePath.c_str(), "w");
+            if (!file) {
+                return false;
+            }
+            size_t count = std::min(m_Count.load(std::memory_order_acquire), Capacity);
+            std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+            bool first = true;
+            for (size_t i = 0; i < count; ++i) {
+                if (!m_Ready[i].load(std::memory_order_acquire)) {
+                    continue; // Still being written
+                }
+                const Span& span = m_Spans[i];
+                std::fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%ld",
+                    first ? "" : ",\n", _Escape(span.name).c_str(), span.category, span.start, span.duration,
+                    static_cast<int>(getpid()), span.tid);
+                if (span.hasUsage) {
+                    std::fprintf(file, ",\"args\":{\"cpu_user_ms\":%.3f,\"cpu_sys_ms\":%.3f,\"max_rss_kb\":%ld,\"exit_code\":%d}",
+                        span.userMs, span.systemMs, span.maxRssKb, span.exitCode);
+                }
+                std::fprintf(file, "}");
+                first = false;
+            }
+            std::fprintf(file, "\n]}\n");
+            return std::fclose(file) == 0;
+        }
+
+    private:
+        static std::string _Escape(const std::string& text) {
+            std::string escaped;
+            escaped.reserve(text.size());
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    escaped += '\\';
+                    escaped += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                }
+                else {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+    private:
+        std::atomic<bool> m_Enabled = false;
+        std::atomic<size_t> m_Count = 0;
+        std::unique_ptr<Span[]> m_Spans;
+        std::unique_ptr<std::atomic<bool>[]> m_Ready;
+        std::chrono::steady_clock::time_point m_Epoch;
+        std::string m_FilePath;
+    };
+
+    // Records the span from construction to destruction, free when tracing is off
+    // The name is name and detail joined by a space, put together only when tracing
+    // is on, so callers pass the pieces instead of building the string themselves
+    class Scope {
+    public:
+        Scope(const char* category, std::string_view name, std::string_view detail = std::string_view()) {
+            if (!Tracer::Get().IsEnabled()) {
+                return;
+            }
+            m_Active = true;
+            m_Span.category = category;
+            m_Span.name.reserve(name.size() + 1 + detail.size());
+            m_Span.name.append(name);
+            if (!detail.empty()) {
+                m_Span.name.append(" ").append(detail);
+            }
+            m_Span.start = Tracer::Get().Now();
+            m_Span.tid = static_cast<long>(syscall(SYS_gettid));
+        }
+        ~Scope() {
+            if (!m_Active) {
+                return;
+            }
+            m_Span.duration = Tracer::Get().Now() - m_Span.start;
+            Tracer::Get().Record(std::move(m_Span));
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        // Attach the CPU time and peak memory of the child this span waited for
+        void SetResult(const Process::Result& result) {
+            if (!m_Active) {
+                return;
+            }
+            auto ms = [](const timeval& tv) { return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0; };
+            m_Span.hasUsage = true;
+            m_Span.userMs = ms(result.usage.ru_utime);
+            m_Span.systemMs = ms(result.usage.ru_stime);
+            m_Span.maxRssKb = result.usage.ru_maxrss;
+            m_Span.exitCode = result.signal != 0 ? 128 + result.signal : result.exitCode;
+        }
+
+    private:
+        bool m_Active = false;
+        Span m_Span;
+    };
+} // namespace Trace
+
+#endif /*TRACE_H_*/
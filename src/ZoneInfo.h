@@ -0,0 +1,115 @@
+#ifndef ZONEINFO_H_
+#define ZONEINFO_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+// Timezone names read straight from the tz database, listed the same way
+// `timedatectl list-timezones` does it
+namespace ZoneInfo
+{
+    // Zone and link names from the compact tzdata.zi source
+    // Lines look like "Z Africa/Abidjan 0 - GMT" or "L Africa/Abidjan Africa/Accra"
+    bool _ParseTzdataZi(const std::string& path, std::vector<std::string>& zones) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            char type = line[0];
+            if (type != 'Z' && type != 'z' && type != 'L' && type != 'l') {
+                continue;
+            }
+            std::istringstream iss(line.substr(1));
+            std::string name;
+            iss >> name;
+            if (type == 'L' || type == 'l') {
+                iss >> name; // The second name is the link itself
+            }
+            if (!name.empty()) {
+                zones.push_back(std::move(name));
+            }
+        }
+        return true;
+    }
+
+    // Third column of zone1970.tab, for trees shipped without tzdata.zi
+    bool _ParseZoneTab(const std::string& path, std::vector<std::string>& zones) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream iss(line);
+            std::string codes, coordinates, name;
+            if (iss >> codes >> coordinates >> name) {
+                zones.push_back(std::move(name));
+            }
+        }
+        return true;
+    }
+
+    // Last resort, every compiled TZif file under the root
+    void _WalkTree(const std::string& root, std::vector<std::string>& zones) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+            const std::string name = it->path().lexically_relative(root).string();
+            // Skip the legacy duplicate trees
+            if (it->is_directory(ec)) {
+                if (name == "posix" || name == "right") {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
+            char magic[4] = { 0 };
+            std::ifstream file(it->path(), std::ios::binary);
+            if (file.read(magic, sizeof(magic)) && std::string(magic, 4) == "TZif" &&
+                name.find('/') != std::string::npos) {
+                zones.push_back(name);
+            }
+        }
+    }
+
+    // Sorted, newline separated, ready to be handed to Menu::Init
+    std::string ListTimezones(const std::string& root = "/usr/share/zoneinfo") {
+        std::vector<std::string> zones;
+        if (!_ParseTzdataZi(root + "/tzdata.zi", zones) &&
+            !_ParseZoneTab(root + "/zone1970.tab", zones)) {
+            _WalkTree(root, zones);
+        }
+        if (zones.empty()) {
+            return "";
+        }
+        zones.push_back("UTC"); // timedatectl always lists it
+
+        std::sort(zones.begin(), zones.end());
+        zones.erase(std::unique(zones.begin(), zones.end()), zones.end());
+
+        size_t size = 0;
+        for (const auto& zone : zones) {
+            size += zone.size() + 1;
+        }
+        std::string output;
+        output.reserve(size);
+        for (const auto& zone : zones) {
+            output.append(zone).push_back('\n');
+        }
+        return output;
+    }
+} // namespace ZoneInfo
+
+#endif /*ZONEINFO_H_*/
@@ -4,6 +4,9 @@
 struct Args {
     std::vector<std::string> steps;
     bool debugMode = false;
+    bool scriptMode = false;
+    std::string traceFile;
+    std::string answersFile;
 };
 
 Args parseArguments(int argc, const char* argv[]) {
@@ -18,6 +21,9 @@ Args parseArguments(int argc, const char* argv[]) {
             << "  -h          Show this help message\n"
             << "  -s [steps]  Specify installation steps (e.g., -s 1,2,3)\n"
             << "  -d          Enable debug mode (dry run, step-by-step execution)\n"
+            << "  -c [file]   Run unattended, taking every answer from file (key = value lines)\n"
+            << "  -x          Run the steps from the Commands file next to the executable\n"
+            << "  -t [file]   Write a Chrome/Perfetto trace of every command and menu to file\n"
             << "  -v          Show version information\n"
             << "\nThis program is a command-line installer for Arch Linux, "
             << "written in C++ and using ncurses for the UI.\n"
@@ -26,6 +32,13 @@ Args parseArguments(int argc, const char* argv[]) {
             << "  Step 2: Select the mirrors, and install the base packages\n"
             << "  Step 3: Configure the system and install the boot loader\n"
             << "If no steps are specified, all steps are run.\n"
+            << "With -x, ${keymap} and ${timezone} in the Commands file are asked for on first use "
+            << "and commands between '# parallel' and '# end parallel' run concurrently.\n"
+            << "Answer keys: keymap, timezone, disk, label, partition (sfdisk line), format (<n> <mkfs>), "
+            << "mount (<n> <path>), packages, locale, hostname, username, root_password, user_password, boot_dir.\n"
+            << "The output of every command is logged to /tmp/arch-installer/install.*.log.gz, "
+            << "with install.idx giving where each command starts and ends, and copied to "
+            << "/mnt/var/log/arch-installer at the end.\n"
             << "In debug mode, no commands are run; instead, a dry run is performed. "
             << "If run under a debugger, a debug break occurs after each dry run step.\n"
             << "For more information, visit: www.github.com/InfinitePain/Arch-Installer\n";
@@ -49,6 +62,20 @@ Args parseArguments(int argc, const char* argv[]) {
         args.debugMode = true;
     }
 
+    if (findArg("-x") != cmdArgs.end()) {
+        args.scriptMode = true;
+    }
+
+    auto answers = findArg("-c");
+    if (answers != cmdArgs.end() && std::next(answers) != cmdArgs.end()) {
+        args.answersFile = *std::next(answers);
+    }
+
+    auto trace = findArg("-t");
+    if (trace != cmdArgs.end() && std::next(trace) != cmdArgs.end()) {
+        args.traceFile = *std::next(trace);
+    }
+
     auto it = findArg("-s");
     if (it != cmdArgs.end() && std::next(it) != cmdArgs.end()) {
         std::stringstream ss(*std::next(it));
@@ -64,9 +91,8 @@ Args parseArguments(int argc, const char* argv[]) {
     return args;
 }
 
-int main(int argc, char const* argv[]) {
-    Args parsedArgs = parseArguments(argc, argv);
-
+// Runs the chosen steps, returns the exit status
+int runInstaller(const Args& parsedArgs) {
     Installer installer;
     if (!installer.Init()) {
         std::cerr << "Failed to initialize installer" << std::endl;
@@ -82,12 +108,27 @@ int main(int argc, char const* argv[]) {
 
     if (parsedArgs.debugMode)
         installer.DebugMode();
+    if (!parsedArgs.answersFile.empty()) {
+        try {
+            installer.Unattended(parsedArgs.answersFile);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    // The Commands file carries its own ordering
+    if (!parsedArgs.scriptMode)
+        installer.ScheduleBackgroundTasks(parsedArgs.steps);
 
     // Installer
     try {
         for (std::string step : parsedArgs.steps) {
             int stepNumber = std::stoi(step);
-            if (stepNumber > 0 && stepNumber <= stepsFunctions.size()) {
+            if (parsedArgs.scriptMode) {
+                installer.RunScriptStep(stepNumber);
+            }
+            else if (stepNumber > 0 && stepNumber <= stepsFunctions.size()) {
                 stepsFunctions[stepNumber - 1]();
             }
             else {
@@ -101,3 +142,24 @@ int main(int argc, char const* argv[]) {
     }
     return 0;
 }
+
+int main(int argc, char const* argv[]) {
+    Args parsedArgs = parseArguments(argc, argv);
+    if (!parsedArgs.traceFile.empty()) {
+        Trace::Tracer::Get().Enable(parsedArgs.traceFile);
+    }
+
+    // Dry runs start no children, so there is nothing to log
+    if (!parsedArgs.debugMode && !InstallLog::Recorder::Get().Start("/tmp/arch-installer")) {
+        std::cerr << "Failed to start the install log in /tmp/arch-installer" << std::endl;
+    }
+
+    // The Installer is destroyed by now, so the background tasks its destructor
+    // waited for are in the log and the trace too
+    int status = runInstaller(parsedArgs);
+    InstallLog::Recorder::Get().Stop();
+    if (!Trace::Tracer::Get().Dump()) {
+        std::cerr << "Failed to write trace: " << parsedArgs.traceFile << std::endl;
+    }
+    return status;
+}
@@ -0,0 +1,111 @@
+#ifndef BLOCKDEVICESTEST_H_
+#define BLOCKDEVICESTEST_H_
+
+#include "Test.h"
+#include "BlockDevices.h"
+
+namespace Test
+{
+    // /sys/block/<name> links into /sys/devices, like the real tree
+    void _FakeDisk(TempDir& sys, const std::string& name, const std::string& sectors,
+        bool rotational, bool removable, const std::string& model) {
+        std::string dir = "devices/virtual/block/" + name + "/";
+        sys.Write(dir + "size", sectors + "\n");
+        sys.Write(dir + "ro", "0\n");
+        sys.Write(dir + "removable", removable ? "1\n" : "0\n");
+        sys.Write(dir + "queue/rotational", rotational ? "1\n" : "0\n");
+        sys.Mkdir(dir + "holders");
+        if (!model.empty()) {
+            sys.Write(dir + "device/model", model + "   \n"); // Padded like SCSI models
+        }
+        sys.Symlink("../devices/virtual/block/" + name, "block/" + name);
+    }
+
+    void _FakePartition(TempDir& sys, const std::string& disk, const std::string& name, int number,
+        const std::string& sectors) {
+        std::string dir = "devices/virtual/block/" + disk + "/" + name + "/";
+        sys.Write(dir + "size", sectors + "\n");
+        sys.Write(dir + "ro", "0\n");
+        sys.Write(dir + "partition", std::to_string(number) + "\n");
+        sys.Mkdir(dir + "holders");
+    }
+
+    void BlockDevicesTests() {
+        Run("blockdevices/disks and partitions", []() {
+            TempDir sys;
+            _FakeDisk(sys, "sda", "976773168", true, false, "WDC WD5000AAKX");
+            _FakePartition(sys, "sda", "sda2", 2, "975724544");
+            _FakePartition(sys, "sda", "sda1", 1, "1048576");
+            sys.Write("devices/virtual/block/sda/sda2/holders/dm-0", "");
+            _FakeDisk(sys, "nvme0n1", "1000215216", false, false, "Samsung SSD 970");
+            _FakePartition(sys, "nvme0n1", "nvme0n1p1", 1, "1000212480");
+
+            std::vector<BlockDevices::BlockDevice> disks = BlockDevices::Scan(sys.GetPath());
+            CHECK_EQ(disks.size(), 2u);
+            if (disks.size() != 2) {
+                return;
+            }
+            const BlockDevices::BlockDevice& nvme = disks[0];
+            CHECK_EQ(nvme.name, "nvme0n1");
+            CHECK(!nvme.rotational);
+            CHECK_EQ(nvme.partitions.size(), 1u);
+
+            const BlockDevices::BlockDevice& sda = disks[1];
+            CHECK_EQ(sda.name, "sda");
+            CHECK_EQ(sda.size, 976773168ull * 512);
+            CHECK_EQ(sda.model, "WDC WD5000AAKX");
+            CHECK(sda.rotational);
+            CHECK(!sda.removable);
+            // "queue", "holders" and "device" aren't partitions, the rest sort by number
+            CHECK_EQ(sda.partitions.size(), 2u);
+            if (sda.partitions.size() == 2) {
+                CHECK_EQ(sda.partitions[0].name, "sda1");
+                CHECK_EQ(sda.partitions[0].partitionNumber, 1);
+                CHECK_EQ(sda.partitions[1].name, "sda2");
+                CHECK_EQ(sda.partitions[1].partitionNumber, 2);
+                CHECK(sda.partitions[1].rotational); // Inherited from the disk
+                CHECK_EQ(sda.partitions[1].holders.size(), 1u);
+                CHECK_EQ(sda.partitions[0].model, "");
+            }
+            });
+
+        Run("blockdevices/removable", []() {
+            TempDir sys;
+            _FakeDisk(sys, "sdb", "60437492", false, true, "Flash Drive");
+            _FakePartition(sys, "sdb", "sdb1", 1, "60435456");
+            std::vector<BlockDevices::BlockDevice> disks = BlockDevices::Scan(sys.GetPath());
+            CHECK_EQ(disks.size(), 1u);
+            if (disks.size() == 1) {
+                CHECK(disks[0].removable);
+                CHECK_EQ(disks[0].partitions.size(), 1u);
+                CHECK(!disks[0].partitions.empty() && disks[0].partitions[0].removable);
+            }
+            });
+
+        Run("blockdevices/virtual and empty devices", []() {
+            TempDir sys;
+            _FakeDisk(sys, "loop0", "1638400", false, false, "");
+            _FakeDisk(sys, "zram0", "8388608", false, false, "");
+            _FakeDisk(sys, "ram0", "131072", false, false, "");
+            _FakeDisk(sys, "sr0", "0", false, true, "DVD-RAM"); // No medium
+            _FakeDisk(sys, "vda", "41943040", true, false, "");
+            std::vector<BlockDevices::BlockDevice> disks = BlockDevices::Scan(sys.GetPath());
+            CHECK_EQ(disks.size(), 1u);
+            if (disks.size() == 1) {
+                CHECK_EQ(disks[0].name, "vda");
+                CHECK_EQ(disks[0].model, "");
+            }
+            CHECK(BlockDevices::Scan(sys.GetPath() + "/missing").empty());
+            });
+
+        Run("blockdevices/format size", []() {
+            CHECK_EQ(BlockDevices::FormatSize(512), "512B");
+            CHECK_EQ(BlockDevices::FormatSize(1024 * 1024), "1M");
+            CHECK_EQ(BlockDevices::FormatSize(976773168ull * 512), "465.8G");
+            CHECK_EQ(BlockDevices::FormatSize(1000215216ull * 512), "476.9G");
+            CHECK_EQ(BlockDevices::FormatSize(4000787030016ull), "3.6T");
+            });
+    }
+} // namespace Test
+
+#endif /*BLOCKDEVICESTEST_H_*/
@@ -0,0 +1,224 @@
+#ifndef MIRRORRANKERTEST_H_
+#define MIRRORRANKERTEST_H_
+
+#include <thread>
+#include <chrono>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "Test.h"
+#include "MirrorRanker.h"
+
+namespace Test
+{
+    // Local stand-in for a mirror, answers each connection with response after delay
+    class _StandIn {
+    public:
+        _StandIn(std::string response, std::chrono::milliseconds delay = std::chrono::milliseconds(0)) :
+            m_Response(std::move(response)), m_Delay(delay) {
+            m_Listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (m_Listen == -1 || bind(m_Listen, reinterpret_cast<sockaddr*>(&address), length) == -1 ||
+                listen(m_Listen, 16) == -1 || pipe(m_Stop) == -1 ||
+                getsockname(m_Listen, reinterpret_cast<sockaddr*>(&address), &length) == -1) {
+                throw std::runtime_error("Failed to start a stand-in server");
+            }
+            m_Port = ntohs(address.sin_port);
+            m_Thread = std::thread(&_StandIn::_Serve, this);
+        }
+        ~_StandIn() {
+            write(m_Stop[1], "x", 1);
+            m_Thread.join();
+            close(m_Listen);
+            close(m_Stop[0]);
+            close(m_Stop[1]);
+        }
+
+        std::string GetServer(const std::string& scheme = "http") const {
+            return scheme + "://127.0.0.1:" + std::to_string(m_Port) + "/$repo/os/$arch";
+        }
+
+        // A port nothing listens on, connecting to it is refused
+        static std::string RefusingServer() {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            bind(fd, reinterpret_cast<sockaddr*>(&address), length);
+            getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+            close(fd);
+            return "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/$repo/os/$arch";
+        }
+
+    private:
+        // Returns false once asked to stop
+        bool _WaitFor(int fd, int timeoutMs) {
+            pollfd fds[2] = { { m_Stop[0], POLLIN, 0 }, { fd, POLLIN, 0 } };
+            poll(fds, fd == -1 ? 1 : 2, timeoutMs);
+            return !(fds[0].revents & POLLIN);
+        }
+
+        void _Serve() {
+            while (_WaitFor(m_Listen, -1)) {
+                int client = accept4(m_Listen, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client == -1) {
+                    continue;
+                }
+                std::string request;
+                char buffer[1024];
+                while (request.find("\r\n\r\n") == std::string::npos && _WaitFor(client, -1)) {
+                    ssize_t count = read(client, buffer, sizeof(buffer));
+                    if (count <= 0) {
+                        break;
+                    }
+                    request.append(buffer, count);
+                }
+                if (_WaitFor(-1, static_cast<int>(m_Delay.count()))) {
+                    send(client, m_Response.data(), m_Response.size(), MSG_NOSIGNAL);
+                }
+                close(client);
+            }
+        }
+
+    private:
+        std::string m_Response;
+        std::chrono::milliseconds m_Delay;
+        int m_Listen = -1;
+        int m_Stop[2] = { -1, -1 };
+        uint16_t m_Port = 0;
+        std::thread m_Thread;
+    };
+
+    std::string _HttpOk(size_t bodySize) {
+        return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(bodySize) + "\r\n\r\n" + std::string(bodySize, 'x');
+    }
+
+    const Mirrors::Mirror* _Find(const std::vector<Mirrors::Mirror>& mirrors, const std::string& server) {
+        for (const auto& mirror : mirrors) {
+            if (mirror.server == server) {
+                return &mirror;
+            }
+        }
+        return nullptr;
+    }
+
+    void MirrorRankerTests() {
+        Run("mirrors/parse mirrorlist", []() {
+            TempDir dir;
+            std::string path = dir.Write("mirrorlist",
+                "## Germany\n"
+                "#Server = http://commented.example/$repo/os/$arch\n"
+                "# Server = https://also-commented.example/$repo/os/$arch\n"
+                "Server = https://a.example/archlinux/$repo/os/$arch\n"
+                "  Server=http://b.example/$repo/os/$arch\n"
+                "Server = https://a.example/archlinux/$repo/os/$arch\n");
+            std::vector<Mirrors::Mirror> mirrors = Mirrors::ParseMirrorlist(path);
+            CHECK_EQ(mirrors.size(), 2u);
+            if (mirrors.size() == 2) {
+                CHECK_EQ(mirrors[0].server, "https://a.example/archlinux/$repo/os/$arch");
+                CHECK_EQ(mirrors[1].server, "http://b.example/$repo/os/$arch");
+            }
+            });
+
+        Run("mirrors/parse server", []() {
+            Mirrors::ProbeOptions options;
+            Mirrors::Mirror mirror;
+            mirror.server = "http://[::1]:8080/arch/$repo/os/$arch";
+            CHECK(Mirrors::_ParseServer(mirror, options));
+            CHECK_EQ(mirror.host, "::1");
+            CHECK_EQ(mirror.port, "8080");
+            CHECK_EQ(mirror.path, "/arch/core/os/x86_64/core.db");
+            CHECK(!mirror.tls);
+
+            mirror.server = "https://[2001:db8::2]/$repo/os/$arch";
+            CHECK(Mirrors::_ParseServer(mirror, options));
+            CHECK_EQ(mirror.host, "2001:db8::2");
+            CHECK_EQ(mirror.port, "443");
+            CHECK(mirror.tls);
+
+            mirror.server = "http://mirror.example:81";
+            CHECK(Mirrors::_ParseServer(mirror, options));
+            CHECK_EQ(mirror.host, "mirror.example");
+            CHECK_EQ(mirror.port, "81");
+            CHECK_EQ(mirror.path, "/core.db");
+
+            mirror.server = "ftp://mirror.example/$repo";
+            CHECK(!Mirrors::_ParseServer(mirror, options));
+            mirror.server = "http://[::1/$repo";
+            CHECK(!Mirrors::_ParseServer(mirror, options));
+            });
+
+        Run("mirrors/probe stand-ins", []() {
+            _StandIn fast(_HttpOk(64 * 1024));
+            _StandIn slow(_HttpOk(64 * 1024), std::chrono::milliseconds(3000));
+            _StandIn redirect("HTTP/1.1 301 Moved Permanently\r\nLocation: https://x/\r\nContent-Length: 0\r\n\r\n");
+            _StandIn missing("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+            std::string refusing = _StandIn::RefusingServer();
+
+            std::vector<Mirrors::Mirror> mirrors(6);
+            mirrors[0].server = slow.GetServer();
+            mirrors[1].server = refusing;
+            mirrors[2].server = redirect.GetServer();
+            mirrors[3].server = missing.GetServer();
+            mirrors[4].server = fast.GetServer("https"); // Only connected to
+            mirrors[5].server = fast.GetServer();
+
+            Mirrors::ProbeOptions options;
+            options.timeout = std::chrono::milliseconds(300);
+            auto start = std::chrono::steady_clock::now();
+            Mirrors::Probe(mirrors, options);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            CHECK(elapsed < std::chrono::milliseconds(1500)); // The slow one doesn't hold up the rest
+
+            CHECK(!mirrors[0].ok);
+            CHECK_EQ(mirrors[0].error, "Timed out");
+            CHECK(!mirrors[1].ok);
+            CHECK(!mirrors[1].error.empty());
+            CHECK(mirrors[2].ok);
+            CHECK_EQ(mirrors[2].bytesPerSecond, 0.0);
+            CHECK(!mirrors[3].ok);
+            CHECK_EQ(mirrors[3].error, "HTTP 404");
+            CHECK(mirrors[4].ok);
+            CHECK(mirrors[4].latencyMs >= 0.0);
+            CHECK(mirrors[5].ok);
+            CHECK(mirrors[5].bytesPerSecond > 0.0);
+
+            std::vector<Mirrors::Mirror> ranked = Mirrors::Rank(mirrors, 5);
+            CHECK_EQ(ranked.size(), 3u);
+            if (!ranked.empty()) {
+                CHECK_EQ(ranked[0].server, fast.GetServer()); // The only measured download
+            }
+            CHECK(_Find(ranked, slow.GetServer()) == nullptr);
+            CHECK(_Find(ranked, refusing) == nullptr);
+            });
+
+        Run("mirrors/rank order", []() {
+            std::vector<Mirrors::Mirror> mirrors(5);
+            const double rates[] = { 1000.0, 0.0, 5000.0, 0.0, 3000.0 };
+            const double latencies[] = { 10.0, 5.0, 50.0, 2.0, 20.0 };
+            for (size_t i = 0; i < mirrors.size(); ++i) {
+                mirrors[i].server = std::to_string(i);
+                mirrors[i].ok = true;
+                mirrors[i].bytesPerSecond = rates[i];
+                mirrors[i].latencyMs = latencies[i];
+            }
+            mirrors[4].ok = false;
+            std::vector<Mirrors::Mirror> ranked = Mirrors::Rank(mirrors, 3);
+            CHECK_EQ(ranked.size(), 3u);
+            if (ranked.size() == 3) {
+                CHECK_EQ(ranked[0].server, "2");
+                CHECK_EQ(ranked[1].server, "0");
+                CHECK_EQ(ranked[2].server, "3"); // Connect only, lowest latency
+            }
+            });
+    }
+} // namespace Test
+
+#endif /*MIRRORRANKERTEST_H_*/
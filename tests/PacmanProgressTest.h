@@ -0,0 +1,126 @@
+#ifndef PACMANPROGRESSTEST_H_
+#define PACMANPROGRESSTEST_H_
+
+#include "Test.h"
+#include "PacmanProgress.h"
+
+namespace Test
+{
+    // Feeds a transcript one line at a time, as CLI::RunCommand hands it over
+    void _FeedTranscript(PacmanProgress& progress, const std::string& transcript,
+        PacmanProgress::Clock::time_point now) {
+        size_t start = 0;
+        while (start < transcript.size()) {
+            size_t end = transcript.find('\n', start);
+            if (end == std::string::npos) {
+                end = transcript.size();
+            }
+            progress.Feed(std::string_view(transcript).substr(start, end - start), now);
+            start = end + 1;
+        }
+    }
+
+    // pacstrap through a pipe, shortened
+    const char* _PacstrapTranscript =
+        "==> Creating install root at /mnt\n"
+        "==> Installing packages to /mnt\n"
+        ":: Synchronizing package databases...\n"
+        " core downloading...\n"
+        " extra downloading...\n"
+        "resolving dependencies...\n"
+        "looking for conflicting packages...\n"
+        "\n"
+        "Packages (4) acl-2.3.2-1  attr-2.5.2-1  linux-6.8.2.arch2-1  base-3-2\n"
+        "\n"
+        "Total Download Size:   200.00 MiB\n"
+        "Total Installed Size:  300.00 MiB\n"
+        "\n"
+        ":: Proceed with installation? [Y/n] \n"
+        ":: Retrieving packages...\n"
+        " acl-2.3.2-1-x86_64 downloading...\n"
+        " attr-2.5.2-1-x86_64 downloading...\n";
+
+    void PacmanProgressTests() {
+        using Phase = PacmanProgress::Phase;
+        PacmanProgress::Clock::time_point start = PacmanProgress::Clock::now();
+
+        Run("pacman/download phase", [start]() {
+            PacmanProgress progress;
+            progress.Feed("", start);
+            CHECK(progress.GetPhase() == Phase::Preparing);
+            _FeedTranscript(progress, _PacstrapTranscript, start);
+            CHECK(progress.GetPhase() == Phase::Downloading);
+            CHECK_EQ(progress.GetDone(), 2u);
+            CHECK_EQ(progress.GetTotal(), 4u);
+            CHECK_EQ(progress.GetPackage(), "attr-2.5.2-1-x86_64");
+            CHECK_EQ(progress.GetDownloadTotal(), 200.0 * 1024 * 1024);
+            // The package in flight counts half
+            CHECK_EQ(progress.GetDownloaded(), 200.0 * 1024 * 1024 * 1.5 / 4);
+            CHECK_EQ(progress.GetBytesPerSecond(start + std::chrono::seconds(5)), 200.0 * 1024 * 1024 * 1.5 / 4 / 5);
+            // 2 of 4 in 10 s, 10 s to go
+            CHECK_EQ(progress.GetEta(start + std::chrono::seconds(10)), 10.0);
+            CHECK(progress.GetLastError().empty());
+            });
+
+        Run("pacman/install and hooks", [start]() {
+            PacmanProgress progress;
+            _FeedTranscript(progress, _PacstrapTranscript, start);
+            _FeedTranscript(progress,
+                ":: Processing package changes...\n"
+                "installing acl...\n"
+                "installing attr...\n"
+                "Optional dependencies for attr\n"
+                "    perl: for scripts\n"
+                "installing linux...\n", start);
+            CHECK(progress.GetPhase() == Phase::Installing);
+            CHECK_EQ(progress.GetDone(), 3u);
+            CHECK_EQ(progress.GetTotal(), 4u);
+            CHECK_EQ(progress.GetPackage(), "linux");
+            CHECK_EQ(progress.GetDownloaded(), 200.0 * 1024 * 1024);
+
+            // With a terminal the counter comes first and progress bars are \r separated
+            progress.Feed("(4/4) installing base        [#####      ]  50%\r(4/4) installing base        [###########] 100%", start);
+            CHECK_EQ(progress.GetDone(), 4u);
+            CHECK_EQ(progress.GetPackage(), "base");
+
+            _FeedTranscript(progress,
+                ":: Running post-transaction hooks...\n"
+                "(1/3) Creating system user accounts...\n"
+                "(2/3) Updating journal message catalog...\n", start);
+            CHECK(progress.GetPhase() == Phase::Hooks);
+            CHECK_EQ(progress.GetDone(), 2u);
+            CHECK_EQ(progress.GetTotal(), 3u);
+            CHECK_EQ(progress.GetPackage(), "Updating journal message catalog...");
+            CHECK_EQ(progress.GetEta(start + std::chrono::seconds(4)), 2.0);
+
+            progress.Finish();
+            CHECK(progress.GetPhase() == Phase::Done);
+            CHECK(progress.GetPackage().empty());
+            });
+
+        Run("pacman/errors", [start]() {
+            PacmanProgress progress;
+            _FeedTranscript(progress, _PacstrapTranscript, start);
+            _FeedTranscript(progress,
+                "error: failed retrieving file 'linux-6.8.2.arch2-1-x86_64.pkg.tar.zst' from mirror : Operation too slow\n"
+                "warning: too many errors from mirror, skipping for the remainder of this transaction\n"
+                "error: failed to commit transaction (failed to retrieve some files)\n", start);
+            CHECK_EQ(progress.GetLastError(), "error: failed to commit transaction (failed to retrieve some files)");
+            CHECK(progress.GetPhase() == Phase::Downloading); // Errors don't move the phase
+            CHECK_EQ(progress.GetDone(), 2u);
+            });
+
+        Run("pacman/nothing to do", [start]() {
+            PacmanProgress progress;
+            _FeedTranscript(progress,
+                ":: Synchronizing package databases...\n"
+                "warning: base-3-2 is up to date -- skipping\n"
+                " there is nothing to do\n", start);
+            CHECK(progress.GetPhase() == Phase::Done);
+            CHECK_EQ(progress.GetDownloadTotal(), 0.0);
+            CHECK_EQ(progress.GetDownloaded(), 0.0);
+            });
+    }
+} // namespace Test
+
+#endif /*PACMANPROGRESSTEST_H_*/
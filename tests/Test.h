@@ -0,0 +1,123 @@
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <stdexcept>
+
+namespace Test
+{
+    struct Options {
+        std::string filter;     // Only run tests whose name contains this
+    };
+
+    inline Options& GetOptions() {
+        static Options options;
+        return options;
+    }
+
+    inline size_t& _Failures() {
+        static size_t failures = 0;
+        return failures;
+    }
+
+    inline size_t& _CurrentFailures() {
+        static size_t failures = 0;
+        return failures;
+    }
+
+    // Records a failed check, the test keeps going so one run shows every failure
+    inline void _Fail(const char* file, int line, const std::string& what) {
+        std::printf("    %s:%d: %s\n", file, line, what.c_str());
+        ++_CurrentFailures();
+    }
+
+    template<typename A, typename B>
+    void _CheckEqual(const A& actual, const B& expected, const char* expression, const char* file, int line) {
+        if (!(actual == expected)) {
+            std::ostringstream oss;
+            oss << expression << " is \"" << actual << "\", expected \"" << expected << "\"";
+            _Fail(file, line, oss.str());
+        }
+    }
+
+#define CHECK(condition) \
+    do { if (!(condition)) Test::_Fail(__FILE__, __LINE__, "CHECK(" #condition ") failed"); } while (0)
+#define CHECK_EQ(actual, expected) \
+    Test::_CheckEqual((actual), (expected), #actual, __FILE__, __LINE__)
+
+    inline bool _Selected(const std::string& name) {
+        return GetOptions().filter.empty() || name.find(GetOptions().filter) != std::string::npos;
+    }
+
+    // Names are "suite/case", ctest runs one suite per test
+    void Run(const std::string& name, const std::function<void()>& fn) {
+        if (!_Selected(name)) {
+            return;
+        }
+        _CurrentFailures() = 0;
+        try {
+            fn();
+        }
+        catch (const std::exception& e) {
+            _Fail(__FILE__, __LINE__, std::string("Threw ") + e.what());
+        }
+        std::printf("%-4s %s\n", _CurrentFailures() == 0 ? "ok" : "FAIL", name.c_str());
+        std::fflush(stdout);
+        if (_CurrentFailures() > 0) {
+            ++_Failures();
+        }
+    }
+
+    // Fixture tree in a fresh temporary directory, removed with the object
+    class TempDir {
+    public:
+        TempDir() {
+            char path[] = "/tmp/installer-test.XXXXXX";
+            if (!mkdtemp(path)) {
+                throw std::runtime_error("Failed to create a temporary directory");
+            }
+            m_Path = path;
+        }
+        ~TempDir() {
+            std::error_code error;
+            std::filesystem::remove_all(m_Path, error);
+        }
+        TempDir(const TempDir&) = delete;
+        TempDir& operator=(const TempDir&) = delete;
+
+        inline const std::string& GetPath() const { return m_Path; }
+
+        // Creates the parent directories too, returns the full path
+        std::string Write(const std::string& relative, const std::string& content) {
+            std::filesystem::path path = std::filesystem::path(m_Path) / relative;
+            std::filesystem::create_directories(path.parent_path());
+            std::ofstream(path, std::ios::binary) << content;
+            return path.string();
+        }
+
+        std::string Mkdir(const std::string& relative) {
+            std::filesystem::path path = std::filesystem::path(m_Path) / relative;
+            std::filesystem::create_directories(path);
+            return path.string();
+        }
+
+        // target is relative to the link's directory, as sysfs writes them
+        void Symlink(const std::string& target, const std::string& relative) {
+            std::filesystem::path path = std::filesystem::path(m_Path) / relative;
+            std::filesystem::create_directories(path.parent_path());
+            std::filesystem::create_directory_symlink(target, path);
+        }
+
+    private:
+        std::string m_Path;
+    };
+} // namespace Test
+
+#endif /*TEST_H_*/
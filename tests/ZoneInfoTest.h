@@ -0,0 +1,58 @@
+#ifndef ZONEINFOTEST_H_
+#define ZONEINFOTEST_H_
+
+#include "Test.h"
+#include "ZoneInfo.h"
+
+namespace Test
+{
+    void ZoneInfoTests() {
+        Run("zoneinfo/tzdata.zi zones and links", []() {
+            TempDir root;
+            root.Write("tzdata.zi",
+                "# version 2024a\n"
+                "R d 1916 o - Jun 14 23s 1 S\n"
+                "Z Europe/Berlin 0:53:28 - LMT 1893 Ap\n"
+                "1 c CE%sT\n"
+                "Z Africa/Abidjan -0:16:8 - LMT 1912\n"
+                "L Africa/Abidjan Africa/Accra\n"
+                "L Europe/Berlin Arctic/Longyearbyen\n"
+                "Z Europe/Berlin 1 - CET\n");
+            // zone1970.tab is ignored while tzdata.zi exists
+            root.Write("zone1970.tab", "DE\t+5230+01322\tEurope/Nowhere\n");
+            CHECK_EQ(ZoneInfo::ListTimezones(root.GetPath()),
+                "Africa/Abidjan\nAfrica/Accra\nArctic/Longyearbyen\nEurope/Berlin\nUTC\n");
+            });
+
+        Run("zoneinfo/zone1970.tab fallback", []() {
+            TempDir root;
+            root.Write("zone1970.tab",
+                "# tzdb timezone descriptions\n"
+                "#codes\tcoordinates\tTZ\tcomments\n"
+                "DE,DK,NO,SE,SJ\t+5230+01322\tEurope/Berlin\tmost of Germany\n"
+                "\n"
+                "US\t+404251-0740023\tAmerica/New_York\tEastern (most areas)\n");
+            CHECK_EQ(ZoneInfo::ListTimezones(root.GetPath()), "America/New_York\nEurope/Berlin\nUTC\n");
+            });
+
+        Run("zoneinfo/TZif tree walk", []() {
+            TempDir root;
+            const std::string tzif("TZif2\0\0\0", 8);
+            root.Write("Europe/Berlin", tzif);
+            root.Write("America/Argentina/Salta", tzif);
+            root.Write("UTC", tzif);                // Top level names are left out
+            root.Write("posix/Europe/Berlin", tzif); // Legacy duplicates
+            root.Write("right/Europe/Paris", tzif);
+            root.Write("Europe/README", "Not a zone\n");
+            CHECK_EQ(ZoneInfo::ListTimezones(root.GetPath()), "America/Argentina/Salta\nEurope/Berlin\nUTC\n");
+            });
+
+        Run("zoneinfo/missing tree", []() {
+            TempDir root;
+            CHECK_EQ(ZoneInfo::ListTimezones(root.GetPath() + "/missing"), "");
+            CHECK_EQ(ZoneInfo::ListTimezones(root.GetPath()), "");
+            });
+    }
+} // namespace Test
+
+#endif /*ZONEINFOTEST_H_*/
@@ -0,0 +1,31 @@
+#include <cstdio>
+#include <cstring>
+
+#include "Test.h"
+#include "ZoneInfoTest.h"
+#include "BlockDevicesTest.h"
+#include "MirrorRankerTest.h"
+#include "PacmanProgressTest.h"
+
+int main(int argc, char const* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            Test::GetOptions().filter = argv[++i];
+        }
+        else {
+            std::fprintf(stderr, "Usage: %s [--filter substring]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Test::ZoneInfoTests();
+    Test::BlockDevicesTests();
+    Test::MirrorRankerTests();
+    Test::PacmanProgressTests();
+
+    if (Test::_Failures() > 0) {
+        std::printf("%zu failed\n", Test::_Failures());
+        return 1;
+    }
+    return 0;
+}